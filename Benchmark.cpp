@@ -0,0 +1,378 @@
+//============================================================================
+// Name        : Benchmark.cpp
+// Description : Benchmark suite for the loaders and sort engines
+//============================================================================
+//
+// Built as its own program next to the menu-driven one:
+//
+//   g++ -std=c++17 -O2 -pthread Benchmark.cpp CSVparser.cpp Stats.cpp ThreadPool.cpp -o benchmark
+//
+// Every engine runs over the bundled CSVs and over synthetic datasets
+// (sorted, reverse, few distinct titles, random) with warmup runs first,
+// then is timed with steady_clock over repeated runs on a fresh copy of
+// the input. Each result is checked for order and reported as one line of
+// CSV or JSON with percentiles, so runs can be diffed for regressions.
+//
+// Usage: benchmark [--rows 100000,1000000] [--runs 5] [--warmup 1]
+//                  [--threads 1,4] [--format csv|json] [--filter text]
+//                  [--max-quadratic 50000] [file.csv ...]
+
+#define VECTORSORTING_NO_MAIN
+#include "VectorSorting.cpp"
+
+#include <chrono>
+#include <sstream>
+
+namespace {
+
+// Options given on the command line
+struct BenchmarkOptions {
+    vector<size_t> rows; // Sizes of the synthetic datasets
+    vector<unsigned int> threads; // Thread counts for the parallel engines
+    vector<string> files; // CSV files to load and sort
+    size_t runs; // Timed runs per measurement
+    size_t warmup; // Untimed runs before those
+    size_t maxQuadratic; // Largest input given to selectionSort
+    string format; // "csv" or "json"
+    string filter; // Only engines whose name contains this
+
+    BenchmarkOptions() : rows{ 100000, 1000000 }, threads{ 1, 0 }, runs(5), warmup(1),
+                         maxQuadratic(50000), format("csv") {}
+};
+
+// A sort engine: how to run it and how to tell that it worked
+struct Engine {
+    string name; // Name in the report
+    bool parallel; // Whether it runs on the pool
+    bool quadratic; // Whether it is limited to maxQuadratic rows
+    function<void(vector<Bid>&, ThreadPool&)> run; // Sorts the bids
+    function<bool(const vector<Bid>&)> sorted; // Checks the result
+};
+
+// Timings of one measurement, in milliseconds
+struct Samples {
+    vector<double> times; // One per timed run
+
+    // Nearest-rank percentile of the sorted samples
+    double percentile(double p) const {
+        if (times.empty()) {
+            return 0.0;
+        }
+        size_t rank = static_cast<size_t>(ceil(p / 100.0 * times.size()));
+        return times[rank == 0 ? 0 : rank - 1];
+    }
+
+    double mean() const {
+        double sum = 0.0; // Total of the samples
+        for (double time : times) {
+            sum += time;
+        }
+        return times.empty() ? 0.0 : sum / times.size();
+    }
+};
+
+// Check that every pair of neighbours is in order by key
+template <typename Key>
+bool sortedBy(const vector<Bid>& bids, Key key) {
+    for (size_t i = 1; i < bids.size(); i++) {
+        if (key(bids[i]) < key(bids[i - 1])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * The engines under test, in report order.
+ *
+ * @return every engine
+ */
+vector<Engine> engines() {
+    auto byTitle = [](const vector<Bid>& bids) { return isSorted(bids); };
+    auto byId = [](const vector<Bid>& bids) { return isSorted(bids, OrderBy<ByAuctionId>()); };
+    auto byAmount = [](const vector<Bid>& bids) {
+        return sortedBy(bids, [](const Bid& bid) { return bid.amount; });
+    };
+    auto byNumericId = [](const vector<Bid>& bids) {
+        return sortedBy(bids, [](const Bid& bid) { return auctionIdKey(bid.bidId); });
+    };
+    auto byFund = [](const vector<Bid>& bids) {
+        return isSorted(bids, OrderBy<ByFund, Descending<ByAmount>, ByTitle>());
+    };
+
+    return {
+        { "selectionSort", false, true, [](vector<Bid>& bids, ThreadPool&) { selectionSort(bids); }, byTitle },
+        { "quickSort", false, false, [](vector<Bid>& bids, ThreadPool&) { quickSort(bids, 0, bids.size() - 1); }, byTitle },
+        { "quickSort3Way", false, false, [](vector<Bid>& bids, ThreadPool&) { quickSort3Way(bids, 0, bids.size() - 1); }, byTitle },
+        { "mergeSort", false, false, [](vector<Bid>& bids, ThreadPool&) { mergeSort(bids); }, byTitle },
+        { "indexSort", false, false, [](vector<Bid>& bids, ThreadPool&) { applyPermutation(bids, sortedIndex(bids)); }, byTitle },
+        { "radixSort", false, false, [](vector<Bid>& bids, ThreadPool&) { radixSort(bids, &Bid::title); }, byTitle },
+        { "radixSortById", false, false, [](vector<Bid>& bids, ThreadPool&) { radixSort(bids, &Bid::bidId); }, byId },
+        { "radixSortByAmount", false, false, [](vector<Bid>& bids, ThreadPool&) { radixSortByAmount(bids); }, byAmount },
+        { "radixSortByAuctionId", false, false, [](vector<Bid>& bids, ThreadPool&) { radixSortByAuctionId(bids); }, byNumericId },
+        { "mergeSortByFund", false, false, [](vector<Bid>& bids, ThreadPool&) {
+              mergeSort(bids, OrderBy<ByFund, Descending<ByAmount>, ByTitle>());
+          }, byFund },
+        { "parallelQuickSort", true, false, [](vector<Bid>& bids, ThreadPool& pool) { parallelQuickSort(bids, pool); }, byTitle },
+        { "parallelMergeSort", true, false, [](vector<Bid>& bids, ThreadPool& pool) { parallelMergeSort(bids, pool); }, byTitle },
+    };
+}
+
+/**
+ * Build a synthetic dataset. Titles are made of a few words and a
+ * number, so they share prefixes the way real auction titles do.
+ *
+ * @param store The store to fill; cleared first
+ * @param kind "sorted", "reverse", "duplicates" or "random"
+ * @param rows Number of bids
+ */
+void synthesize(BidStore& store, const string& kind, size_t rows) {
+    static const char* const WORDS[] = { "Steel", "Desk", "Chair", "Cabinet", "Truck", "Laptop", "Office",
+                                         "Mower", "Table", "Lot", "Ford", "Dell", "Oak", "File", "Lamp", "Bike" };
+    static const size_t WORD_COUNT = sizeof(WORDS) / sizeof(WORDS[0]);
+    static const char* const FUNDS[] = { "General Fund", "Enterprise", "" };
+
+    store.clear();
+    store.bids.reserve(rows);
+    mt19937_64 random(rows); // Same data for the same size on every run
+    size_t distinct = (kind == "duplicates") ? 100 : rows; // Distinct titles
+    string text; // Title being built
+
+    for (size_t i = 0; i < rows; i++) {
+        uint64_t seed = random() % distinct; // Picks the title
+        text.clear();
+        text.append(WORDS[seed % WORD_COUNT]).append(" ");
+        text.append(WORDS[(seed / WORD_COUNT) % WORD_COUNT]).append(" ");
+        text.append(to_string(seed));
+
+        Bid bid; // The new bid
+        bid.bidId = store.strings.store(to_string(80000 + i));
+        bid.title = store.strings.store(text);
+        bid.titleKey = titlePrefix(bid.title);
+        bid.fundId = store.funds.intern(FUNDS[random() % 3]);
+        bid.fund = store.funds.name(bid.fundId);
+        bid.amount = static_cast<double>(random() % 1000000) / 100.0;
+        bid.closeDate = 20140101 + static_cast<uint32_t>(random() % 28);
+        store.bids.push_back(bid);
+    }
+
+    if (kind == "sorted" || kind == "reverse") {
+        radixSort(store.bids, &Bid::title);
+        if (kind == "reverse") {
+            reverse(store.bids.begin(), store.bids.end());
+        }
+    }
+}
+
+/**
+ * Time a task over warmup and timed runs. prepare runs before each run
+ * and is not timed.
+ *
+ * @param options Warmup and run counts
+ * @param prepare Resets the input
+ * @param task The work being timed
+ * @return the timings, sorted
+ */
+Samples measure(const BenchmarkOptions& options, const function<void()>& prepare,
+                const function<void()>& task) {
+    Samples samples; // Timings of the timed runs
+    for (size_t run = 0; run < options.warmup + options.runs; run++) {
+        prepare();
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        task();
+        chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+        if (run >= options.warmup) {
+            samples.times.push_back(elapsed.count());
+        }
+    }
+    sort(samples.times.begin(), samples.times.end());
+    return samples;
+}
+
+/**
+ * Print one result line.
+ *
+ * @param options Output format
+ * @param benchmark Name of what was timed
+ * @param dataset Name of the input
+ * @param rows Size of the input
+ * @param threads Threads used
+ * @param ok Whether the result checked out
+ * @param samples The timings, sorted
+ */
+void report(const BenchmarkOptions& options, const string& benchmark, const string& dataset,
+            size_t rows, unsigned int threads, bool ok, const Samples& samples) {
+    double values[] = { samples.percentile(0), samples.percentile(50), samples.percentile(90),
+                        samples.percentile(99), samples.percentile(100), samples.mean() };
+    static const char* const NAMES[] = { "min_ms", "p50_ms", "p90_ms", "p99_ms", "max_ms", "mean_ms" };
+
+    ostringstream line; // Built whole, then written in one go
+    if (options.format == "json") {
+        line << "{\"benchmark\":\"" << benchmark << "\",\"dataset\":\"" << dataset << "\",\"rows\":" << rows
+             << ",\"threads\":" << threads << ",\"runs\":" << samples.times.size()
+             << ",\"ok\":" << (ok ? "true" : "false");
+        for (size_t i = 0; i < 6; i++) {
+            line << ",\"" << NAMES[i] << "\":" << values[i];
+        }
+        line << "}";
+    } else {
+        line << benchmark << ',' << dataset << ',' << rows << ',' << threads << ','
+             << samples.times.size() << ',' << (ok ? "ok" : "FAILED");
+        for (size_t i = 0; i < 6; i++) {
+            line << ',' << values[i];
+        }
+    }
+    cout << line.str() << endl;
+}
+
+/**
+ * Run every selected engine over one dataset.
+ *
+ * @param options What to run and how often
+ * @param dataset Name of the input
+ * @param input The bids to sort; left unchanged
+ * @param pools One pool per thread count in options.threads
+ */
+void sortDataset(const BenchmarkOptions& options, const string& dataset, const vector<Bid>& input,
+                 vector<unique_ptr<ThreadPool>>& pools) {
+    for (const Engine& engine : engines()) {
+        if (engine.name.find(options.filter) == string::npos) {
+            continue;
+        }
+        if (engine.quadratic && input.size() > options.maxQuadratic) {
+            continue; // Would take hours
+        }
+        for (size_t p = 0; p < pools.size(); p++) {
+            if (!engine.parallel && p != 0) {
+                break; // Serial engines don't care about the thread count
+            }
+            ThreadPool& pool = *pools[p];
+            vector<Bid> bids; // Fresh copy for each run
+            Samples samples = measure(options, [&]() { bids = input; }, [&]() { engine.run(bids, pool); });
+            bool ok = bids.size() == input.size() && engine.sorted(bids);
+            report(options, engine.name, dataset, input.size(), engine.parallel ? pool.size() : 1, ok, samples);
+        }
+    }
+}
+
+const char* const USAGE = "usage: benchmark [--rows 100000,1000000] [--runs 5] [--warmup 1]\n"
+                          "                 [--threads 1,4] [--format csv|json] [--filter text]\n"
+                          "                 [--max-quadratic 50000] [file.csv ...]";
+
+/**
+ * Parse one whole non-negative number.
+ *
+ * @param text The number
+ * @return its value
+ * @throws invalid_argument if text is not a number or does not fit
+ */
+size_t number(const string& text) {
+    if (text.empty() || text.find_first_not_of("0123456789") != string::npos) {
+        throw invalid_argument("expected a number, not '" + text + "'");
+    }
+    try {
+        return stoull(text);
+    } catch (const out_of_range&) {
+        throw invalid_argument(text + " is out of range");
+    }
+}
+
+/**
+ * Split a comma separated list of numbers.
+ *
+ * @param text The list
+ * @return the numbers
+ * @throws invalid_argument for an item that is not a number
+ */
+vector<size_t> numbers(const string& text) {
+    vector<size_t> values; // Parsed numbers
+    istringstream input(text); // Reads one number per item
+    string item; // One item of the list
+    while (getline(input, item, ',')) {
+        values.push_back(number(item));
+    }
+    return values;
+}
+
+}
+
+/**
+ * Parse the options, then benchmark loading each file, sorting each
+ * file's bids and sorting every synthetic dataset.
+ */
+int main(int argc, char* argv[]) {
+    BenchmarkOptions options; // Settings from the command line
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i]; // Current argument
+        bool hasValue = i + 1 < argc; // Whether a value follows
+        try {
+            if (arg == "--rows" && hasValue) {
+                options.rows = numbers(argv[++i]);
+            } else if (arg == "--runs" && hasValue) {
+                options.runs = number(argv[++i]);
+            } else if (arg == "--warmup" && hasValue) {
+                options.warmup = number(argv[++i]);
+            } else if (arg == "--threads" && hasValue) {
+                options.threads.clear();
+                for (size_t count : numbers(argv[++i])) {
+                    options.threads.push_back(static_cast<unsigned int>(count));
+                }
+            } else if (arg == "--format" && hasValue) {
+                options.format = argv[++i];
+            } else if (arg == "--filter" && hasValue) {
+                options.filter = argv[++i];
+            } else if (arg == "--max-quadratic" && hasValue) {
+                options.maxQuadratic = number(argv[++i]);
+            } else if (!arg.empty() && arg[0] == '-') {
+                cerr << "unknown option " << arg << endl << USAGE << endl;
+                return 2;
+            } else {
+                options.files.push_back(arg);
+            }
+        } catch (const invalid_argument& e) {
+            cerr << arg << ": " << e.what() << endl << USAGE << endl;
+            return 2;
+        }
+    }
+    if (options.files.empty()) {
+        options.files = { "eBid_Monthly_Sales.csv", "eBid_Monthly_Sales_Dec_2016.csv" };
+    }
+    if (options.threads.empty() || options.runs == 0) {
+        cerr << "need at least one thread count and one run" << endl;
+        return 2;
+    }
+
+    vector<unique_ptr<ThreadPool>> pools; // One per thread count
+    for (unsigned int count : options.threads) {
+        pools.emplace_back(new ThreadPool(count));
+    }
+    if (options.format == "csv") {
+        cout << "benchmark,dataset,rows,threads,runs,status,min_ms,p50_ms,p90_ms,p99_ms,max_ms,mean_ms" << endl;
+    }
+
+    for (const string& file : options.files) {
+        BidStore store; // The file's bids, kept for the sorts
+        if (string("loadBids").find(options.filter) != string::npos) {
+            streambuf* console = cout.rdbuf(nullptr); // loadBids talks; keep the report clean
+            Samples samples = measure(options, [&]() { store.clear(); }, [&]() { store = loadBids(file); });
+            cout.rdbuf(console);
+            cout.clear(); // Writes to the null buffer set badbit
+            report(options, "loadBids", file, store.bids.size(), 1, !store.bids.empty(), samples);
+        } else {
+            streambuf* console = cout.rdbuf(nullptr);
+            store = loadBids(file);
+            cout.rdbuf(console);
+            cout.clear();
+        }
+        sortDataset(options, file, store.bids, pools);
+    }
+
+    for (size_t rows : options.rows) {
+        for (const char* kind : { "sorted", "reverse", "duplicates", "random" }) {
+            BidStore store; // Synthetic bids
+            synthesize(store, kind, rows);
+            sortDataset(options, kind, store.bids, pools);
+        }
+    }
+    return 0;
+}
@@ -1,36 +1,650 @@
+#include <algorithm>
+#include <atomic>
+#include <bitset>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
 #include <fstream>
 #include <sstream>
 #include <iomanip>
+#include <thread>
 #include "CSVparser.hpp"
+#include "Stats.hpp"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+# define CSV_SIMD_X86 1
+# include <immintrin.h>
+#endif
+
+#ifdef _WIN32
+# include <windows.h>
+#else
+# include <fcntl.h>
+# include <sys/mman.h>
+# include <sys/stat.h>
+# include <unistd.h>
+#endif
+
+#ifdef CSV_HAVE_ZLIB
+# include <zlib.h>
+#endif
+#ifdef CSV_HAVE_ZSTD
+# include <zstd.h>
+#endif
 
 namespace csv {
 
-  Parser::Parser(const std::string &data, const DataType &type, char sep)
+  namespace
+  {
+    bool isWanted(const std::vector<bool> &columns, unsigned int pos)
+    {
+        return pos >= columns.size() || columns[pos];
+    }
+
+    /*
+    ** Structural scan kernels. Each one classifies a 64-byte block into a
+    ** bit mask of quote positions and a bit mask of separator/newline
+    ** positions (bit i = byte i). The best kernel for the running CPU is
+    ** picked once; the scalar one also handles the tail of a buffer.
+    */
+    typedef void (*ClassifyFn)(const char *, char, uint64_t &, uint64_t &);
+
+    void classifyScalar(const char *pos, std::size_t n, char sep,
+                        uint64_t &quotes, uint64_t &structurals)
+    {
+        quotes = 0;
+        structurals = 0;
+        for (std::size_t i = 0; i != n; i++)
+        {
+            quotes |= static_cast<uint64_t>(pos[i] == '"') << i;
+            structurals |= static_cast<uint64_t>(pos[i] == sep || pos[i] == '\n') << i;
+        }
+    }
+
+    void classifyBlockScalar(const char *pos, char sep, uint64_t &quotes, uint64_t &structurals)
+    {
+        classifyScalar(pos, 64, sep, quotes, structurals);
+    }
+
+#ifdef CSV_SIMD_X86
+    __attribute__((target("sse2")))
+    void classifyBlockSse2(const char *pos, char sep, uint64_t &quotes, uint64_t &structurals)
+    {
+        const __m128i quote = _mm_set1_epi8('"');
+        const __m128i separator = _mm_set1_epi8(sep);
+        const __m128i newline = _mm_set1_epi8('\n');
+
+        quotes = 0;
+        structurals = 0;
+        for (int i = 0; i != 4; i++)
+        {
+            __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(pos + 16 * i));
+            uint64_t q = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, quote)));
+            uint64_t st = static_cast<uint32_t>(_mm_movemask_epi8(
+                _mm_or_si128(_mm_cmpeq_epi8(chunk, separator), _mm_cmpeq_epi8(chunk, newline))));
+            quotes |= q << (16 * i);
+            structurals |= st << (16 * i);
+        }
+    }
+
+    __attribute__((target("avx2")))
+    void classifyBlockAvx2(const char *pos, char sep, uint64_t &quotes, uint64_t &structurals)
+    {
+        const __m256i quote = _mm256_set1_epi8('"');
+        const __m256i separator = _mm256_set1_epi8(sep);
+        const __m256i newline = _mm256_set1_epi8('\n');
+
+        __m256i lo = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(pos));
+        __m256i hi = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(pos + 32));
+        uint64_t qlo = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, quote)));
+        uint64_t qhi = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, quote)));
+        uint64_t slo = static_cast<uint32_t>(_mm256_movemask_epi8(
+            _mm256_or_si256(_mm256_cmpeq_epi8(lo, separator), _mm256_cmpeq_epi8(lo, newline))));
+        uint64_t shi = static_cast<uint32_t>(_mm256_movemask_epi8(
+            _mm256_or_si256(_mm256_cmpeq_epi8(hi, separator), _mm256_cmpeq_epi8(hi, newline))));
+        quotes = qlo | (qhi << 32);
+        structurals = slo | (shi << 32);
+    }
+#endif
+
+    ClassifyFn selectClassifier(void)
+    {
+#ifdef CSV_SIMD_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2"))
+          return classifyBlockAvx2;
+        if (__builtin_cpu_supports("sse2"))
+          return classifyBlockSse2;
+#endif
+        return classifyBlockScalar;
+    }
+
+    ClassifyFn classifier(void)
+    {
+        static const ClassifyFn fn = selectClassifier();
+        return fn;
+    }
+
+    /*
+    ** Mask of the bytes that sit inside quotes: bit i is the parity of the
+    ** quotes at positions <= i.
+    */
+    uint64_t prefixXor(uint64_t bits)
+    {
+        bits ^= bits << 1;
+        bits ^= bits << 2;
+        bits ^= bits << 4;
+        bits ^= bits << 8;
+        bits ^= bits << 16;
+        bits ^= bits << 32;
+        return bits;
+    }
+
+    /*
+    ** Classifies [pos, pos + n), n <= 64, and returns the separators and
+    ** newlines that are outside quotes. `quoted` carries the quote state
+    ** from one block into the next.
+    */
+    uint64_t structuralBlock(ClassifyFn classify, const char *pos, std::size_t n, char sep,
+                             bool &quoted)
+    {
+        uint64_t quotes;
+        uint64_t structurals;
+
+        if (n == 64)
+          classify(pos, sep, quotes, structurals);
+        else
+          classifyScalar(pos, n, sep, quotes, structurals);
+
+        uint64_t inside = prefixXor(quotes) ^ (quoted ? ~uint64_t(0) : 0);
+        if (n == 64)
+          quoted = (inside >> 63) != 0;
+        else
+          quoted = ((inside >> (n - 1)) & 1) != 0;
+        return structurals & ~inside;
+    }
+
+    int lowestBit(uint64_t bits)
+    {
+#ifdef __GNUC__
+        return __builtin_ctzll(bits);
+#else
+        int i = 0;
+        while (!(bits & 1))
+        {
+          bits >>= 1;
+          i++;
+        }
+        return i;
+#endif
+    }
+
+    /*
+    ** Splits the record starting at `pos` into `fields` and returns the
+    ** position of its terminating newline, or `end` if the buffer ran out
+    ** first. Newlines and separators inside double quotes belong to the
+    ** field. Columns switched off in `columns` are pushed as empty views.
+    */
+    const char *splitRecord(const char *pos, const char *end, char sep,
+                            const std::vector<bool> &columns,
+                            std::vector<std::string_view> &fields)
+    {
+        ClassifyFn classify = classifier();
+        bool quoted = false;
+        const char *tokenStart = pos;
+        unsigned int column = 0;
+
+        const char *stop = end;
+
+        for (; pos < end && stop == end; pos += 64)
+        {
+            std::size_t n = std::min<std::size_t>(64, end - pos);
+            uint64_t bits = structuralBlock(classify, pos, n, sep, quoted);
+
+            for (; bits != 0; bits &= bits - 1)
+            {
+                const char *at = pos + lowestBit(bits);
+                if (*at == '\n')
+                {
+                  stop = at;
+                  break;
+                }
+                if (isWanted(columns, column++))
+                    fields.emplace_back(tokenStart, at - tokenStart);
+                else
+                    fields.emplace_back();
+                tokenStart = at + 1;
+            }
+        }
+        pos = stop;
+
+        const char *last = pos;
+        if (last != tokenStart && last[-1] == '\r')
+            last--;
+        if (isWanted(columns, column))
+            fields.emplace_back(tokenStart, last - tokenStart);
+        else
+            fields.emplace_back();
+        return pos;
+    }
+
+    bool isBlank(const std::vector<std::string_view> &fields)
+    {
+        return fields.size() == 1 && fields[0].empty();
+    }
+
+    /*
+    ** Tokenizes every record in [pos, end), appending `columnCount` views
+    ** per record to `fields`. Blank lines are skipped.
+    */
+    void parseRecords(const char *pos, const char *end, char sep,
+                      const std::vector<bool> &columns, std::size_t columnCount,
+                      std::vector<std::string_view> &fields)
+    {
+        std::size_t first = 0;
+        std::size_t rows = 0;
+
+        STATS_ADD(BYTES_SCANNED, end - pos);
+        while (pos != end)
+        {
+            first = fields.size();
+            pos = splitRecord(pos, end, sep, columns, fields);
+            if (pos != end)
+              pos++;
+
+            // blank line
+            if (fields.size() == first + 1 && fields.back().empty())
+            {
+              fields.pop_back();
+              continue;
+            }
+
+            // if value(s) missing
+            if (fields.size() - first != columnCount)
+              throw Error("corrupted data !");
+            rows++;
+        }
+        STATS_ADD(ROWS_PARSED, rows);
+        (void)rows;
+    }
+
+    std::size_t countQuotes(const char *pos, const char *end)
+    {
+        ClassifyFn classify = classifier();
+        std::size_t count = 0;
+        uint64_t quotes;
+        uint64_t structurals;
+
+        for (; end - pos >= 64; pos += 64)
+        {
+            classify(pos, '"', quotes, structurals);
+#ifdef __GNUC__
+            count += __builtin_popcountll(quotes);
+#else
+            count += std::bitset<64>(quotes).count();
+#endif
+        }
+        return count + std::count(pos, end, '"');
+    }
+  }
+
+  /*
+  ** INPUT
+  */
+
+  namespace
+  {
+# ifdef _WIN32
+    typedef HANDLE FileHandle;
+# else
+    typedef int FileHandle;
+# endif
+
+    /*
+    ** Reads up to `size` bytes at `offset` without touching a shared file
+    ** position. Returns 0 at end of file.
+    */
+    std::size_t readAt(FileHandle handle, std::uint64_t offset, char *buffer, std::size_t size)
+    {
+# ifdef _WIN32
+        OVERLAPPED at = OVERLAPPED();
+        at.Offset = static_cast<DWORD>(offset);
+        at.OffsetHigh = static_cast<DWORD>(offset >> 32);
+        DWORD got = 0;
+        if (!ReadFile(handle, buffer, static_cast<DWORD>(std::min<std::size_t>(size, 1u << 30)), &got, &at))
+        {
+          if (GetLastError() == ERROR_HANDLE_EOF)
+            return 0;
+          throw Error("read failed");
+        }
+        return got;
+# else
+        ssize_t got;
+        do
+          got = ::pread(handle, buffer, size, static_cast<off_t>(offset));
+        while (got < 0 && errno == EINTR);
+        if (got < 0)
+          throw Error(std::string("read failed: ").append(std::strerror(errno)));
+        return static_cast<std::size_t>(got);
+# endif
+    }
+
+    // the file itself, read with positioned reads
+    class FileInput : public Input
+    {
+    public:
+        FileInput(const std::string &file)
+          : _offset(0)
+        {
+# ifdef _WIN32
+            _handle = CreateFileA(file.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                                  OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+            if (_handle == INVALID_HANDLE_VALUE)
+              throw Error(std::string("Failed to open ").append(file));
+# else
+            _handle = ::open(file.c_str(), O_RDONLY);
+            if (_handle < 0)
+              throw Error(std::string("Failed to open ").append(file));
+#  ifdef POSIX_FADV_SEQUENTIAL
+            ::posix_fadvise(_handle, 0, 0, POSIX_FADV_SEQUENTIAL);
+#  endif
+# endif
+        }
+
+        ~FileInput(void)
+        {
+# ifdef _WIN32
+            CloseHandle(_handle);
+# else
+            ::close(_handle);
+# endif
+        }
+
+        std::size_t read(char *buffer, std::size_t size)
+        {
+            std::size_t got = readAt(_handle, _offset, buffer, size);
+            _offset += got;
+            return got;
+        }
+
+        // the first bytes of the file, without consuming them
+        std::size_t peek(char *buffer, std::size_t size)
+        {
+            return readAt(_handle, 0, buffer, size);
+        }
+
+    private:
+        FileHandle _handle;
+        std::uint64_t _offset;
+    };
+
+    enum Compression
+    {
+        eNONE,
+        eGZIP,
+        eZSTD
+    };
+
+    Compression sniff(const char *data, std::size_t size)
+    {
+        const unsigned char *bytes = reinterpret_cast<const unsigned char *>(data);
+
+        if (size >= 2 && bytes[0] == 0x1f && bytes[1] == 0x8b)
+          return eGZIP;
+        if (size >= 4 && bytes[0] == 0x28 && bytes[1] == 0xb5 && bytes[2] == 0x2f && bytes[3] == 0xfd)
+          return eZSTD;
+        return eNONE;
+    }
+
+    const std::size_t COMPRESSED_CHUNK = 1 << 17;
+
+# ifdef CSV_HAVE_ZLIB
+    /*
+    ** gzip stream, inflated as it is read. Concatenated members (as
+    ** written by `cat a.gz b.gz`) decode as one stream, like gunzip does.
+    */
+    class GzipInput : public Input
+    {
+    public:
+        GzipInput(std::unique_ptr<FileInput> file, const std::string &name)
+          : _file(std::move(file)), _name(name), _buffer(COMPRESSED_CHUNK), _eof(false), _done(false)
+        {
+            _stream = z_stream();
+            // 15 window bits + 16: gzip wrapper only
+            if (inflateInit2(&_stream, 15 + 16) != Z_OK)
+              throw Error(std::string("can't inflate ").append(_name));
+        }
+
+        ~GzipInput(void)
+        {
+            inflateEnd(&_stream);
+        }
+
+        std::size_t read(char *buffer, std::size_t size)
+        {
+            if (size == 0)
+              return 0;
+            _stream.next_out = reinterpret_cast<Bytef *>(buffer);
+            _stream.avail_out = static_cast<uInt>(std::min<std::size_t>(size, 1u << 30));
+
+            while (!_done && _stream.next_out == reinterpret_cast<Bytef *>(buffer))
+            {
+                if (_stream.avail_in == 0 && !_eof)
+                {
+                  std::size_t got = _file->read(_buffer.data(), _buffer.size());
+                  _eof = got == 0;
+                  _stream.next_in = reinterpret_cast<Bytef *>(_buffer.data());
+                  _stream.avail_in = static_cast<uInt>(got);
+                }
+
+                int status = inflate(&_stream, Z_NO_FLUSH);
+                if (status == Z_STREAM_END)
+                {
+                  // another member may follow; zero padding after the
+                  // last one is ignored, as gzip(1) does
+                  if (!skipPadding())
+                    _done = true;
+                  else if (inflateReset(&_stream) != Z_OK)
+                    throw Error(std::string("corrupt gzip data in ").append(_name));
+                }
+                else if (status == Z_BUF_ERROR && _eof && _stream.avail_in == 0)
+                  throw Error(std::string("truncated gzip data in ").append(_name));
+                else if (status != Z_OK && status != Z_BUF_ERROR)
+                  throw Error(std::string("corrupt gzip data in ").append(_name));
+            }
+            return reinterpret_cast<char *>(_stream.next_out) - buffer;
+        }
+
+    private:
+        bool refill(void)
+        {
+            if (_eof)
+              return false;
+            std::size_t got = _file->read(_buffer.data(), _buffer.size());
+            _eof = got == 0;
+            _stream.next_in = reinterpret_cast<Bytef *>(_buffer.data());
+            _stream.avail_in = static_cast<uInt>(got);
+            return got != 0;
+        }
+
+        // false once only zero bytes are left
+        bool skipPadding(void)
+        {
+            while (true)
+            {
+                while (_stream.avail_in != 0 && *_stream.next_in == 0)
+                {
+                    _stream.next_in++;
+                    _stream.avail_in--;
+                }
+                if (_stream.avail_in != 0)
+                  return true;
+                if (!refill())
+                  return false;
+            }
+        }
+
+        std::unique_ptr<FileInput> _file;
+        std::string _name;
+        std::vector<char> _buffer;
+        z_stream _stream;
+        bool _eof;
+        bool _done;
+    };
+# endif
+
+# ifdef CSV_HAVE_ZSTD
+    /*
+    ** zstd stream, decompressed as it is read. Several frames back to
+    ** back decode as one stream.
+    */
+    class ZstdInput : public Input
+    {
+    public:
+        ZstdInput(std::unique_ptr<FileInput> file, const std::string &name)
+          : _file(std::move(file)), _name(name), _buffer(ZSTD_DStreamInSize()),
+            _stream(ZSTD_createDStream()), _pending(0), _full(false), _eof(false)
+        {
+            _input.src = _buffer.data();
+            _input.size = 0;
+            _input.pos = 0;
+            if (_stream == nullptr)
+              throw Error(std::string("can't decompress ").append(_name));
+        }
+
+        ~ZstdInput(void)
+        {
+            ZSTD_freeDStream(_stream);
+        }
+
+        std::size_t read(char *buffer, std::size_t size)
+        {
+            ZSTD_outBuffer output = { buffer, size, 0 };
+
+            while (output.pos == 0 && size != 0)
+            {
+                // a full output buffer may leave decoded bytes to flush
+                if (_input.pos == _input.size && !(_full && _pending != 0))
+                {
+                  if (_eof)
+                    break;
+                  std::size_t got = _file->read(_buffer.data(), _buffer.size());
+                  _eof = got == 0;
+                  _input.size = got;
+                  _input.pos = 0;
+                  if (_eof)
+                    continue;
+                }
+                // non-zero: the current frame is not finished yet
+                _pending = ZSTD_decompressStream(_stream, &output, &_input);
+                if (ZSTD_isError(_pending))
+                  throw Error(std::string("corrupt zstd data in ").append(_name));
+                _full = output.pos == output.size;
+            }
+            if (output.pos == 0 && _eof && _pending != 0)
+              throw Error(std::string("truncated zstd data in ").append(_name));
+            return output.pos;
+        }
+
+    private:
+        std::unique_ptr<FileInput> _file;
+        std::string _name;
+        std::vector<char> _buffer;
+        ZSTD_DStream *_stream;
+        ZSTD_inBuffer _input;
+        std::size_t _pending;
+        bool _full;
+        bool _eof;
+    };
+# endif
+  }
+
+  std::unique_ptr<Input> Input::open(const std::string &file)
+  {
+      std::unique_ptr<FileInput> input(new FileInput(file));
+      char magic[4];
+      Compression compression = sniff(magic, input->peek(magic, sizeof(magic)));
+
+      switch (compression)
+      {
+        case eGZIP:
+# ifdef CSV_HAVE_ZLIB
+          return std::unique_ptr<Input>(new GzipInput(std::move(input), file));
+# else
+          throw Error(file + " is gzip-compressed; build with CSV_HAVE_ZLIB to read it");
+# endif
+        case eZSTD:
+# ifdef CSV_HAVE_ZSTD
+          return std::unique_ptr<Input>(new ZstdInput(std::move(input), file));
+# else
+          throw Error(file + " is zstd-compressed; build with CSV_HAVE_ZSTD to read it");
+# endif
+        default:
+          return std::unique_ptr<Input>(input.release());
+      }
+  }
+
+  Input::~Input(void) {}
+
+  std::size_t Input::fill(char *buffer, std::size_t size)
+  {
+      std::size_t total = 0;
+      while (total != size)
+      {
+          std::size_t got = read(buffer + total, size - total);
+          if (got == 0)
+            break;
+          total += got;
+      }
+      return total;
+  }
+
+  /*
+  ** PARSER
+  */
+
+  Parser::Parser(const std::string &data, const DataType &type, char sep,
+                 const Projection &columns)
     : _type(type), _sep(sep)
   {
       std::string line;
       if (type == eFILE)
       {
         _file = data;
-        std::ifstream ifile(_file.c_str());
-        if (ifile.is_open())
+        std::unique_ptr<Input> input = Input::open(_file);
+        std::vector<char> chunk(1 << 16);
+        std::size_t got;
+
+        // split the (possibly decompressed) stream into lines
+        while ((got = input->read(chunk.data(), chunk.size())) != 0)
         {
-            while (ifile.good())
+            const char *pos = chunk.data();
+            const char *end = pos + got;
+            while (pos != end)
             {
-                getline(ifile, line);
+                const char *newline = static_cast<const char *>(std::memchr(pos, '\n', end - pos));
+                if (newline == nullptr)
+                {
+                  line.append(pos, end);
+                  break;
+                }
+                line.append(pos, newline);
                 if (line != "")
-                    _originalFile.push_back(line);
+                  _originalFile.push_back(line);
+                line.clear();
+                pos = newline + 1;
             }
-            ifile.close();
-
-            if (_originalFile.size() == 0)
-              throw Error(std::string("No Data in ").append(_file));
-            
-            parseHeader();
-            parseContent();
         }
-        else
-            throw Error(std::string("Failed to open ").append(_file));
+        if (line != "")
+          _originalFile.push_back(line);
+
+        if (_originalFile.size() == 0)
+          throw Error(std::string("No Data in ").append(_file));
+
+        parseHeader();
+        _columns = columns.resolve(_schema.names());
+        parseContent();
       }
       else
       {
@@ -42,17 +656,12 @@ namespace csv {
           throw Error(std::string("No Data in pure content"));
 
         parseHeader();
+        _columns = columns.resolve(_schema.names());
         parseContent();
       }
   }
 
-  Parser::~Parser(void)
-  {
-     std::vector<Row *>::iterator it;
-
-     for (it = _content.begin(); it != _content.end(); it++)
-          delete *it;
-  }
+  Parser::~Parser(void) {}
 
   void Parser::parseHeader(void)
   {
@@ -60,49 +669,48 @@ namespace csv {
       std::string item;
 
       while (std::getline(ss, item, _sep))
-          _header.push_back(item);
+          _schema.push(item);
   }
 
   void Parser::parseContent(void)
   {
      std::vector<std::string>::iterator it;
+     std::vector<std::string_view> fields;
      
+     std::size_t bytes = 0;
+     for (it = _originalFile.begin() + 1; it != _originalFile.end(); it++)
+         bytes += it->length();
+     _buffer.data.reserve(bytes);
+     _buffer.spans.reserve((_originalFile.size() - 1) * _schema.size());
+     _content.reserve(_originalFile.size() - 1);
+
      it = _originalFile.begin();
      it++; // skip header
 
      for (; it != _originalFile.end(); it++)
      {
-         bool quoted = false;
-         int tokenStart = 0;
-         unsigned int i = 0;
+         const char *line = it->data();
 
-         Row *row = new Row(_header);
-
-         for (; i != it->length(); i++)
-         {
-              if (it->at(i) == '"')
-                  quoted = ((quoted) ? (false) : (true));
-              else if (it->at(i) == ',' && !quoted)
-              {
-                  row->push(it->substr(tokenStart, i - tokenStart));
-                  tokenStart = i + 1;
-              }
-         }
-
-         //end
-         row->push(it->substr(tokenStart, it->length() - tokenStart));
+         fields.clear();
+         splitRecord(line, line + it->length(), _sep, _columns, fields);
+         STATS_ADD(BYTES_SCANNED, it->length() + 1);
 
          // if value(s) missing
-         if (row->size() != _header.size())
+         if (fields.size() != _schema.size())
           throw Error("corrupted data !");
-         _content.push_back(row);
+
+         std::size_t first = _buffer.spans.size();
+         for (auto field = fields.begin(); field != fields.end(); field++)
+             _buffer.append(*field);
+         _content.push_back(Row(_schema, _buffer, first));
+         STATS_ADD(ROWS_PARSED, 1);
      }
   }
 
   Row &Parser::getRow(unsigned int rowPosition) const
   {
       if (rowPosition < _content.size())
-          return *(_content[rowPosition]);
+          return _content[rowPosition];
       throw Error("can't return this row (doesn't exist)");
   }
 
@@ -118,26 +726,25 @@ namespace csv {
 
   unsigned int Parser::columnCount(void) const
   {
-      return _header.size();
+      return _schema.size();
   }
 
   std::vector<std::string> Parser::getHeader(void) const
   {
-      return _header;
+      return _schema.names();
   }
 
   const std::string Parser::getHeaderElement(unsigned int pos) const
   {
-      if (pos >= _header.size())
+      if (pos >= _schema.size())
         throw Error("can't return this header (doesn't exist)");
-      return _header[pos];
+      return _schema.names()[pos];
   }
 
   bool Parser::deleteRow(unsigned int pos)
   {
     if (pos < _content.size())
     {
-      delete *(_content.begin() + pos);
       _content.erase(_content.begin() + pos);
       return true;
     }
@@ -146,32 +753,32 @@ namespace csv {
 
   bool Parser::addRow(unsigned int pos, const std::vector<std::string> &r)
   {
-    Row *row = new Row(_header);
+    if (pos > _content.size())
+      return false;
 
+    Row row(_schema, _buffer, _buffer.spans.size());
     for (auto it = r.begin(); it != r.end(); it++)
-      row->push(*it);
-    
-    if (pos <= _content.size())
-    {
-      _content.insert(_content.begin() + pos, row);
-      return true;
-    }
-    return false;
+      row.push(*it);
+    _content.insert(_content.begin() + pos, row);
+    return true;
   }
 
   void Parser::sync(void) const
   {
+    if (!_columns.empty())
+      throw Error("can't sync a projected file (columns were skipped)");
     if (_type == DataType::eFILE)
     {
       std::ofstream f;
       f.open(_file, std::ios::out | std::ios::trunc);
 
       // header
+      const std::vector<std::string> &header = _schema.names();
       unsigned int i = 0;
-      for (auto it = _header.begin(); it != _header.end(); it++)
+      for (auto it = header.begin(); it != header.end(); it++)
       {
         f << *it;
-        if (i < _header.size() - 1)
+        if (i < header.size() - 1)
           f << ",";
         else
           f << std::endl;
@@ -179,7 +786,7 @@ namespace csv {
       }
      
       for (auto it = _content.begin(); it != _content.end(); it++)
-        f << **it << std::endl;
+        f << *it << std::endl;
       f.close();
     }
   }
@@ -189,80 +796,902 @@ namespace csv {
       return _file;    
   }
   
+  /*
+  ** SCHEMA
+  */
+
+  Schema::Schema(void) {}
+
+  void Schema::push(const std::string &name)
+  {
+    // emplace keeps the first column registered under a given name
+    _index.emplace(name, _names.size());
+    _names.push_back(name);
+  }
+
+  unsigned int Schema::size(void) const
+  {
+    return _names.size();
+  }
+
+  int Schema::find(const std::string &name) const
+  {
+    auto it = _index.find(name);
+    return it == _index.end() ? -1 : static_cast<int>(it->second);
+  }
+
+  const std::vector<std::string> &Schema::names(void) const
+  {
+    return _names;
+  }
+
+  /*
+  ** FIELD BUFFER
+  */
+
+  std::size_t FieldBuffer::append(const std::string_view &value)
+  {
+    spans.push_back({data.size(), value.size()});
+    data.append(value.data(), value.size());
+    return spans.size() - 1;
+  }
+
+  std::string_view FieldBuffer::view(std::size_t span) const
+  {
+    const Span &s = spans[span];
+    return std::string_view(data.data() + s.offset, s.length);
+  }
+
   /*
   ** ROW
   */
 
-  Row::Row(const std::vector<std::string> &header)
-      : _header(header) {}
+  Row::Row(const Schema &schema, FieldBuffer &buffer, std::size_t first)
+      : _schema(&schema), _buffer(&buffer), _first(first),
+        _size(buffer.spans.size() - first) {}
 
   Row::~Row(void) {}
 
   unsigned int Row::size(void) const
   {
-    return _values.size();
+    return _size;
+  }
+
+  std::string_view Row::field(unsigned int pos) const
+  {
+    return _buffer->view(_first + pos);
   }
 
   void Row::push(const std::string &value)
   {
-    _values.push_back(value);
+    // a row can only grow in place while its spans are the last ones in
+    // the buffer; otherwise its spans (not the text) move to the end
+    if (_first + _size != _buffer->spans.size())
+    {
+      std::size_t first = _buffer->spans.size();
+      for (unsigned int i = 0; i != _size; i++)
+        _buffer->spans.push_back(_buffer->spans[_first + i]);
+      _first = first;
+    }
+    _buffer->append(value);
+    _size++;
   }
 
   bool Row::set(const std::string &key, const std::string &value) 
   {
-    std::vector<std::string>::const_iterator it;
-    int pos = 0;
+    int pos = _schema->find(key);
 
-    for (it = _header.begin(); it != _header.end(); it++)
-    {
-        if (key == *it)
-        {
-          _values[pos] = value;
-          return true;
-        }
-        pos++;
-    }
-    return false;
+    if (pos < 0 || static_cast<unsigned int>(pos) >= _size)
+      return false;
+    // the old text is left behind in the buffer; only the span moves
+    FieldBuffer::Span &span = _buffer->spans[_first + pos];
+    span.offset = _buffer->data.size();
+    span.length = value.size();
+    _buffer->data.append(value);
+    return true;
   }
 
   const std::string Row::operator[](unsigned int valuePosition) const
   {
-       if (valuePosition < _values.size())
-           return _values[valuePosition];
+       if (valuePosition < _size)
+           return std::string(field(valuePosition));
        throw Error("can't return this value (doesn't exist)");
   }
 
   const std::string Row::operator[](const std::string &key) const
   {
-      std::vector<std::string>::const_iterator it;
-      int pos = 0;
+      int pos = _schema->find(key);
 
-      for (it = _header.begin(); it != _header.end(); it++)
-      {
-          if (key == *it)
-              return _values[pos];
-          pos++;
-      }
-      
+      if (pos >= 0 && static_cast<unsigned int>(pos) < _size)
+          return std::string(field(pos));
       throw Error("can't return this value (doesn't exist)");
   }
 
   std::ostream &operator<<(std::ostream &os, const Row &row)
   {
-      for (unsigned int i = 0; i != row._values.size(); i++)
-          os << row._values[i] << " | ";
+      for (unsigned int i = 0; i != row._size; i++)
+          os << row.field(i) << " | ";
 
       return os;
   }
 
   std::ofstream &operator<<(std::ofstream &os, const Row &row)
   {
-    for (unsigned int i = 0; i != row._values.size(); i++)
+    for (unsigned int i = 0; i != row._size; i++)
     {
-        os << row._values[i];
-        if (i < row._values.size() - 1)
+        os << row.field(i);
+        if (i < row._size - 1)
           os << ",";
     }
     return os;
   }
+
+  /*
+  ** PROJECTION
+  */
+
+  Projection::Projection(void) {}
+
+  Projection &Projection::column(unsigned int pos)
+  {
+      _indices.push_back(pos);
+      return *this;
+  }
+
+  Projection &Projection::column(const std::string &name)
+  {
+      _names.push_back(name);
+      return *this;
+  }
+
+  bool Projection::empty(void) const
+  {
+      return _indices.empty() && _names.empty();
+  }
+
+  std::vector<bool> Projection::resolve(const std::vector<std::string> &header) const
+  {
+      if (empty())
+        return std::vector<bool>();
+
+      std::vector<bool> columns(header.size(), false);
+      for (auto it = _indices.begin(); it != _indices.end(); it++)
+      {
+          if (*it >= header.size())
+            throw Error("can't project this column (doesn't exist)");
+          columns[*it] = true;
+      }
+      for (auto it = _names.begin(); it != _names.end(); it++)
+      {
+          auto found = std::find(header.begin(), header.end(), *it);
+          if (found == header.end())
+            throw Error(std::string("can't project this column (doesn't exist) : ").append(*it));
+          columns[found - header.begin()] = true;
+      }
+      return columns;
+  }
+
+  /*
+  ** MAPPED FILE
+  */
+
+#ifdef _WIN32
+  MappedFile::MappedFile(const std::string &file)
+    : _data(nullptr), _size(0), _handle(INVALID_HANDLE_VALUE), _mapping(nullptr)
+  {
+      _handle = CreateFileA(file.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                            OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+      if (_handle == INVALID_HANDLE_VALUE)
+        throw Error(std::string("Failed to open ").append(file));
+
+      LARGE_INTEGER size;
+      if (!GetFileSizeEx(_handle, &size))
+      {
+        CloseHandle(_handle);
+        throw Error(std::string("Failed to open ").append(file));
+      }
+      _size = static_cast<std::size_t>(size.QuadPart);
+      if (_size == 0)
+        return;
+
+      _mapping = CreateFileMappingA(_handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+      if (_mapping != nullptr)
+        _data = static_cast<const char *>(MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0));
+      if (_data == nullptr)
+      {
+        if (_mapping != nullptr)
+          CloseHandle(_mapping);
+        CloseHandle(_handle);
+        throw Error(std::string("Failed to map ").append(file));
+      }
+  }
+
+  MappedFile::~MappedFile(void)
+  {
+      if (_data != nullptr)
+        UnmapViewOfFile(_data);
+      if (_mapping != nullptr)
+        CloseHandle(_mapping);
+      if (_handle != INVALID_HANDLE_VALUE)
+        CloseHandle(_handle);
+  }
+#else
+  MappedFile::MappedFile(const std::string &file)
+    : _data(nullptr), _size(0)
+  {
+      int fd = ::open(file.c_str(), O_RDONLY);
+      if (fd < 0)
+        throw Error(std::string("Failed to open ").append(file));
+
+      struct stat st;
+      if (::fstat(fd, &st) != 0)
+      {
+        ::close(fd);
+        throw Error(std::string("Failed to open ").append(file));
+      }
+      _size = static_cast<std::size_t>(st.st_size);
+
+      if (_size != 0)
+      {
+        void *addr = ::mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (addr == MAP_FAILED)
+        {
+          ::close(fd);
+          throw Error(std::string("Failed to map ").append(file));
+        }
+        ::madvise(addr, _size, MADV_SEQUENTIAL);
+        _data = static_cast<const char *>(addr);
+      }
+      // the mapping keeps its own reference to the file
+      ::close(fd);
+  }
+
+  MappedFile::~MappedFile(void)
+  {
+      if (_data != nullptr)
+        ::munmap(const_cast<char *>(_data), _size);
+  }
+#endif
+
+  const char *MappedFile::data(void) const
+  {
+      return _data;
+  }
+
+  std::size_t MappedFile::size(void) const
+  {
+      return _size;
+  }
+
+  std::string_view MappedFile::view(void) const
+  {
+      return std::string_view(_data, _size);
+  }
+
+  /*
+  ** MAPPED PARSER
+  */
+
+  MappedParser::MappedParser(const std::string &file, char sep,
+                             const Projection &columns)
+    : _file(file), _sep(sep), _map(file), _text(_map.view()),
+      _cursor(nullptr)
+  {
+      if (sniff(_text.data(), _text.size()) != eNONE)
+      {
+        // no views into compressed bytes: inflate the whole file once
+        std::unique_ptr<Input> input = Input::open(_file);
+        std::size_t got;
+        do
+        {
+            std::size_t size = _inflated.size();
+            _inflated.resize(size + (1 << 20));
+            got = input->fill(&_inflated[size], 1 << 20);
+            _inflated.resize(size + got);
+        }
+        while (got != 0);
+        _text = _inflated;
+      }
+      _cursor = _text.data();
+      parseHeader();
+      _columns = columns.resolve(_header);
+      parseContent();
+  }
+
+  MappedParser::~MappedParser(void) {}
+
+  void MappedParser::parseHeader(void)
+  {
+      const char *end = _text.data() + _text.size();
+      std::vector<std::string_view> fields;
+
+      while (_cursor != end)
+      {
+          fields.clear();
+          _cursor = splitRecord(_cursor, end, _sep, _columns, fields);
+          if (_cursor != end)
+            _cursor++;
+          if (!isBlank(fields))
+            break;
+      }
+      if (fields.empty() || isBlank(fields))
+        throw Error(std::string("No Data in ").append(_file));
+
+      for (auto it = fields.begin(); it != fields.end(); it++)
+          _header.emplace_back(*it);
+  }
+
+  void MappedParser::parseContent(void)
+  {
+      const char *end = _text.data() + _text.size();
+      parseRecords(_cursor, end, _sep, _columns, _header.size(), _fields);
+      _cursor = end;
+  }
+
+  RowView MappedParser::getRow(unsigned int rowPosition) const
+  {
+      if (rowPosition < rowCount())
+          return RowView(_header, &_fields[rowPosition * _header.size()]);
+      throw Error("can't return this row (doesn't exist)");
+  }
+
+  RowView MappedParser::operator[](unsigned int rowPosition) const
+  {
+      return MappedParser::getRow(rowPosition);
+  }
+
+  unsigned int MappedParser::rowCount(void) const
+  {
+      return _fields.size() / _header.size();
+  }
+
+  unsigned int MappedParser::columnCount(void) const
+  {
+      return _header.size();
+  }
+
+  std::vector<std::string> MappedParser::getHeader(void) const
+  {
+      return _header;
+  }
+
+  const std::string MappedParser::getHeaderElement(unsigned int pos) const
+  {
+      if (pos >= _header.size())
+        throw Error("can't return this header (doesn't exist)");
+      return _header[pos];
+  }
+
+  const std::string &MappedParser::getFileName(void) const
+  {
+      return _file;
+  }
+
+  /*
+  ** ROW VIEW
+  */
+
+  RowView::RowView(const std::vector<std::string> &header, const std::string_view *values)
+      : _header(&header), _values(values) {}
+
+  unsigned int RowView::size(void) const
+  {
+    return _header->size();
+  }
+
+  std::string_view RowView::operator[](unsigned int valuePosition) const
+  {
+       if (valuePosition < _header->size())
+           return _values[valuePosition];
+       throw Error("can't return this value (doesn't exist)");
+  }
+
+  std::string_view RowView::operator[](const std::string &key) const
+  {
+      for (unsigned int pos = 0; pos != _header->size(); pos++)
+      {
+          if (key == (*_header)[pos])
+              return _values[pos];
+      }
+
+      throw Error("can't return this value (doesn't exist)");
+  }
+
+  std::ostream &operator<<(std::ostream &os, const RowView &row)
+  {
+      for (unsigned int i = 0; i != row.size(); i++)
+          os << row._values[i] << " | ";
+
+      return os;
+  }
+
+  /*
+  ** READER
+  */
+
+  Reader::Reader(const std::string &file, char sep, std::size_t chunkSize,
+                 const Projection &columns)
+    : _file(file), _sep(sep), _chunkSize(chunkSize ? chunkSize : 1),
+      _begin(0), _end(0), _eof(false)
+  {
+      _input = Input::open(_file);
+      _buffer.resize(_chunkSize);
+      while (nextRecord())
+      {
+          if (!isBlank(_fields))
+          {
+            for (auto it = _fields.begin(); it != _fields.end(); it++)
+                _header.emplace_back(*it);
+            _columns = columns.resolve(_header);
+            return;
+          }
+      }
+      throw Error(std::string("No Data in ").append(_file));
+  }
+
+  Reader::~Reader(void) {}
+
+  bool Reader::fill(void)
+  {
+      if (_eof)
+        return false;
+
+      // keep the partial record, then top the buffer up behind it
+      std::size_t pending = _end - _begin;
+      if (_begin != 0)
+        std::copy(_buffer.begin() + _begin, _buffer.begin() + _end, _buffer.begin());
+      _begin = 0;
+      _end = pending;
+      if (_buffer.size() - _end <= _chunkSize / 2)
+        _buffer.resize(_end + _chunkSize);
+
+      std::size_t want = _buffer.size() - _end;
+      std::size_t got = _input->fill(&_buffer[_end], want);
+      _end += got;
+      if (got != want)
+        _eof = true;
+      return got != 0;
+  }
+
+  bool Reader::nextRecord(void)
+  {
+      while (true)
+      {
+          const char *begin = _buffer.data() + _begin;
+          const char *end = _buffer.data() + _end;
+
+          _fields.clear();
+          if (begin != end)
+          {
+            const char *stop = splitRecord(begin, end, _sep, _columns, _fields);
+            if (stop != end || _eof)
+            {
+              STATS_ADD(BYTES_SCANNED, stop - begin + ((stop != end) ? 1 : 0));
+              _begin = (stop - _buffer.data()) + ((stop != end) ? 1 : 0);
+              return true;
+            }
+          }
+          else if (_eof)
+            return false;
+
+          // record runs past the buffered data
+          if (!fill() && _begin == _end)
+            return false;
+      }
+  }
+
+  bool Reader::next(void)
+  {
+      while (nextRecord())
+      {
+          // blank line
+          if (isBlank(_fields))
+            continue;
+
+          // if value(s) missing
+          if (_fields.size() != _header.size())
+            throw Error("corrupted data !");
+          STATS_ADD(ROWS_PARSED, 1);
+          return true;
+      }
+      return false;
+  }
+
+  RowView Reader::row(void) const
+  {
+      return RowView(_header, _fields.data());
+  }
+
+  unsigned int Reader::columnCount(void) const
+  {
+      return _header.size();
+  }
+
+  const std::vector<std::string> &Reader::getHeader(void) const
+  {
+      return _header;
+  }
+
+  const std::string &Reader::getFileName(void) const
+  {
+      return _file;
+  }
+
+  /*
+  ** PIPELINED READER
+  */
+
+  namespace
+  {
+    /*
+    ** Bounded single-producer/single-consumer ring. push() and pop() never
+    ** block; they fail when the ring is full or empty.
+    */
+    template<typename T>
+    class SpscQueue
+    {
+    public:
+        explicit SpscQueue(std::size_t capacity)
+          : _mask(0), _head(0), _tail(0)
+        {
+            std::size_t size = 1;
+            while (size < capacity)
+              size <<= 1;
+            _slots.resize(size);
+            _mask = size - 1;
+        }
+
+        bool push(const T &value)
+        {
+            std::size_t tail = _tail.load(std::memory_order_relaxed);
+            if (tail - _head.load(std::memory_order_acquire) == _slots.size())
+              return false;
+            _slots[tail & _mask] = value;
+            _tail.store(tail + 1, std::memory_order_release);
+            return true;
+        }
+
+        bool pop(T &value)
+        {
+            std::size_t head = _head.load(std::memory_order_relaxed);
+            if (head == _tail.load(std::memory_order_acquire))
+              return false;
+            value = _slots[head & _mask];
+            _head.store(head + 1, std::memory_order_release);
+            return true;
+        }
+
+    private:
+        std::vector<T> _slots;
+        std::size_t _mask;
+        alignas(64) std::atomic<std::size_t> _head;
+        alignas(64) std::atomic<std::size_t> _tail;
+    };
+
+    // spin briefly, then give the core away, then sleep while a stage stalls
+    void backoff(unsigned int &spins)
+    {
+        spins++;
+        if (spins < 64)
+          return;
+        if (spins < 1024)
+          std::this_thread::yield();
+        else
+          std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+
+    /*
+    ** One buffer of the pipeline: raw bytes cut at a record boundary, then
+    ** the fields the parse worker found in them.
+    */
+    struct Chunk
+    {
+        std::vector<char> data;
+        std::size_t size;
+        std::vector<std::string_view> fields;
+        std::exception_ptr error;
+        bool last;
+    };
+
+    /*
+    ** Where the last complete record in [0, size) ends, or 0 if there is
+    ** none. The buffer starts on a record boundary, so the quote parity
+    ** at the end tells which newlines are inside a quoted field.
+    */
+    std::size_t lastRecordEnd(const char *data, std::size_t size)
+    {
+        bool quoted = (countQuotes(data, data + size) & 1) != 0;
+
+        for (std::size_t i = size; i-- != 0;)
+        {
+            if (data[i] == '"')
+              quoted = !quoted;
+            else if (data[i] == '\n' && !quoted)
+              return i + 1;
+        }
+        return 0;
+    }
+  }
+
+  struct PipelinedReader::Pipeline
+  {
+      Pipeline(std::unique_ptr<Input> input, unsigned int workers, std::size_t chunks)
+        : input(std::move(input)), chunks(chunks), spare(chunks + 1), stop(false),
+          sequence(0), current(nullptr), finished(false)
+      {
+          for (unsigned int i = 0; i != workers; i++)
+          {
+              work.emplace_back(new SpscQueue<Chunk *>(chunks + 1));
+              done.emplace_back(new SpscQueue<Chunk *>(chunks + 1));
+          }
+          for (auto it = this->chunks.begin(); it != this->chunks.end(); it++)
+              spare.push(&*it);
+      }
+
+      ~Pipeline(void)
+      {
+          stop.store(true);
+          for (auto it = threads.begin(); it != threads.end(); it++)
+              it->join();
+      }
+
+      // false once the pipeline is shutting down
+      bool send(SpscQueue<Chunk *> &queue, Chunk *chunk)
+      {
+          unsigned int spins = 0;
+          while (!queue.push(chunk))
+          {
+              if (stop.load(std::memory_order_relaxed))
+                return false;
+              backoff(spins);
+          }
+          return true;
+      }
+
+      bool receive(SpscQueue<Chunk *> &queue, Chunk *&chunk)
+      {
+          unsigned int spins = 0;
+          while (!queue.pop(chunk))
+          {
+              if (stop.load(std::memory_order_relaxed))
+                return false;
+              backoff(spins);
+          }
+          return true;
+      }
+
+      void read(std::vector<char> tail, std::size_t chunkSize);
+      void parse(unsigned int worker, char sep, const std::vector<bool> &columns,
+                 std::size_t columnCount);
+
+      std::unique_ptr<Input> input;
+      std::vector<Chunk> chunks;
+      SpscQueue<Chunk *> spare;
+      std::vector<std::unique_ptr<SpscQueue<Chunk *> > > work;
+      std::vector<std::unique_ptr<SpscQueue<Chunk *> > > done;
+      std::vector<std::thread> threads;
+      std::atomic<bool> stop;
+      std::size_t sequence;
+      Chunk *current;
+      bool finished;
+  };
+
+  /*
+  ** Reader stage: fills each free chunk with the partial record left over
+  ** from the previous one plus up to `chunkSize` new bytes, cuts it after
+  ** its last complete record and deals the chunks out round-robin.
+  */
+  void PipelinedReader::Pipeline::read(std::vector<char> tail, std::size_t chunkSize)
+  {
+      std::size_t index = 0;
+      bool eof = false;
+
+      while (!eof)
+      {
+          Chunk *chunk;
+          if (!receive(spare, chunk))
+            return;
+
+          chunk->fields.clear();
+          chunk->error = nullptr;
+          try
+          {
+            std::vector<char> &data = chunk->data;
+            std::size_t size = tail.size();
+            std::size_t cut = 0;
+            if (data.size() < size + chunkSize)
+              data.resize(size + chunkSize);
+            std::copy(tail.begin(), tail.end(), data.begin());
+
+            while (true)
+            {
+                std::size_t want = data.size() - size;
+                std::size_t got = input->fill(data.data() + size, want);
+                size += got;
+                eof = got != want;
+                cut = eof ? size : lastRecordEnd(data.data(), size);
+                if (eof || cut != 0)
+                  break;
+                // a single record longer than the chunk
+                data.resize(data.size() + chunkSize);
+            }
+            tail.assign(data.begin() + cut, data.begin() + size);
+            chunk->size = cut;
+          }
+          catch (...)
+          {
+            chunk->error = std::current_exception();
+            chunk->size = 0;
+            eof = true;
+          }
+          chunk->last = eof;
+          if (!send(*work[index], chunk))
+            return;
+          index = (index + 1) % work.size();
+      }
+
+      // no more chunks: let every worker finish
+      for (auto it = work.begin(); it != work.end(); it++)
+          if (!send(**it, nullptr))
+            return;
+  }
+
+  /*
+  ** Parse stage: tokenizes the chunks dealt to one worker and hands them
+  ** on in the order they came in.
+  */
+  void PipelinedReader::Pipeline::parse(unsigned int worker, char sep,
+                                         const std::vector<bool> &columns,
+                                         std::size_t columnCount)
+  {
+      while (true)
+      {
+          Chunk *chunk;
+          if (!receive(*work[worker], chunk) || chunk == nullptr)
+            return;
+
+          if (!chunk->error)
+          {
+            try
+            {
+              parseRecords(chunk->data.data(), chunk->data.data() + chunk->size,
+                           sep, columns, columnCount, chunk->fields);
+            }
+            catch (...)
+            {
+              chunk->error = std::current_exception();
+            }
+          }
+          if (!send(*done[worker], chunk))
+            return;
+      }
+  }
+
+  PipelinedReader::PipelinedReader(const std::string &file, char sep,
+                                   const Projection &columns, unsigned int workers,
+                                   std::size_t chunkSize)
+    : _file(file), _sep(sep)
+  {
+      if (chunkSize == 0)
+        chunkSize = 1;
+      if (workers == 0)
+      {
+        // the reader and the calling thread take a core each
+        unsigned int cores = std::thread::hardware_concurrency();
+        workers = cores > 2 ? cores - 2 : 1;
+      }
+
+      std::unique_ptr<Input> input = Input::open(_file);
+      std::vector<char> head;
+      std::size_t begin = 0;
+      bool eof = false;
+
+      // the header is read up front: the workers need its column count
+      {
+        std::vector<std::string_view> fields;
+        while (true)
+        {
+            const char *pos = head.data() + begin;
+            const char *end = head.data() + head.size();
+
+            fields.clear();
+            if (pos != end)
+            {
+              const char *stop = splitRecord(pos, end, _sep, _columns, fields);
+              if (stop != end || eof)
+              {
+                begin = (stop - head.data()) + ((stop != end) ? 1 : 0);
+                if (isBlank(fields))
+                  continue;
+                break;
+              }
+            }
+            else if (eof)
+              throw Error(std::string("No Data in ").append(_file));
+
+            std::size_t size = head.size();
+            head.resize(size + (1 << 16));
+            std::size_t got = input->read(head.data() + size, 1 << 16);
+            head.resize(size + got);
+            eof = got == 0;
+        }
+        for (auto it = fields.begin(); it != fields.end(); it++)
+            _header.emplace_back(*it);
+      }
+      _columns = columns.resolve(_header);
+
+      _pipeline.reset(new Pipeline(std::move(input), workers, 2 * workers + 2));
+      std::vector<char> tail(head.begin() + begin, head.end());
+      Pipeline &pipeline = *_pipeline;
+      pipeline.threads.emplace_back([&pipeline, tail, chunkSize]()
+      {
+          pipeline.read(tail, chunkSize);
+      });
+      for (unsigned int i = 0; i != workers; i++)
+          pipeline.threads.emplace_back([this, &pipeline, i]()
+          {
+              pipeline.parse(i, _sep, _columns, _header.size());
+          });
+  }
+
+  PipelinedReader::~PipelinedReader(void) {}
+
+  bool PipelinedReader::nextBatch(void)
+  {
+      Pipeline &pipeline = *_pipeline;
+
+      while (true)
+      {
+          if (pipeline.current != nullptr)
+          {
+            pipeline.send(pipeline.spare, pipeline.current);
+            pipeline.current = nullptr;
+          }
+          if (pipeline.finished)
+            return false;
+
+          Chunk *chunk = nullptr;
+          pipeline.receive(*pipeline.done[pipeline.sequence % pipeline.done.size()], chunk);
+          pipeline.sequence++;
+          pipeline.current = chunk;
+          if (chunk->last)
+            pipeline.finished = true;
+          if (chunk->error)
+          {
+            pipeline.finished = true;
+            std::rethrow_exception(chunk->error);
+          }
+          if (!chunk->fields.empty())
+            return true;
+      }
+  }
+
+  unsigned int PipelinedReader::rowCount(void) const
+  {
+      if (_pipeline->current == nullptr)
+        return 0;
+      return _pipeline->current->fields.size() / _header.size();
+  }
+
+  RowView PipelinedReader::getRow(unsigned int rowPosition) const
+  {
+      if (rowPosition < rowCount())
+          return RowView(_header, &_pipeline->current->fields[rowPosition * _header.size()]);
+      throw Error("can't return this row (doesn't exist)");
+  }
+
+  unsigned int PipelinedReader::columnCount(void) const
+  {
+      return _header.size();
+  }
+
+  const std::vector<std::string> &PipelinedReader::getHeader(void) const
+  {
+      return _header;
+  }
+
+  const std::string &PipelinedReader::getFileName(void) const
+  {
+      return _file;
+  }
 }
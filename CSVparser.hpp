@@ -3,9 +3,13 @@
 
 # include <stdexcept>
 # include <string>
+# include <string_view>
+# include <unordered_map>
 # include <vector>
 # include <list>
+# include <memory>
 # include <sstream>
+# include <fstream>
 
 namespace csv
 {
@@ -19,10 +23,58 @@ namespace csv
         }
     };
 
+    /*
+    ** Column names of a parsed file, shared by every Row it produces.
+    ** Names are hashed once so a lookup by name is O(1); when a name
+    ** appears twice the first column wins, as before.
+    */
+    class Schema
+    {
+    public:
+        Schema(void);
+
+    public:
+        void push(const std::string &);
+        unsigned int size(void) const;
+        int find(const std::string &) const;
+        const std::vector<std::string> &names(void) const;
+
+    private:
+        std::vector<std::string> _names;
+        std::unordered_map<std::string, unsigned int> _index;
+    };
+
+    /*
+    ** Flat storage for the fields of every row of a Parser: the text of
+    ** all fields lives back to back in `data` and each field is an
+    ** (offset, length) span into it. Rows only keep the position of
+    ** their first span, so loading a file costs two growing buffers
+    ** instead of one vector of strings per row.
+    */
+    struct FieldBuffer
+    {
+        struct Span
+        {
+            std::size_t offset;
+            std::size_t length;
+        };
+
+        std::string data;
+        std::vector<Span> spans;
+
+        std::size_t append(const std::string_view &);
+        std::string_view view(std::size_t span) const;
+    };
+
+    /*
+    ** A row is a handle on the parser's FieldBuffer: it stays valid for
+    ** the lifetime of the parser, but like any vector element it may
+    ** move when rows are added or deleted.
+    */
     class Row
     {
     	public:
-    	    Row(const std::vector<std::string> &);
+    	    Row(const Schema &, FieldBuffer &, std::size_t first);
     	    ~Row(void);
 
     	public:
@@ -31,19 +83,23 @@ namespace csv
             bool set(const std::string &, const std::string &); 
 
     	private:
-    		const std::vector<std::string> _header;
-    		std::vector<std::string> _values;
+            std::string_view field(unsigned int) const;
+
+    		const Schema *_schema;
+    		FieldBuffer *_buffer;
+    		std::size_t _first;
+    		unsigned int _size;
 
         public:
 
             template<typename T>
             const T getValue(unsigned int pos) const
             {
-                if (pos < _values.size())
+                if (pos < _size)
                 {
                     T res;
                     std::stringstream ss;
-                    ss << _values[pos];
+                    ss << field(pos);
                     ss >> res;
                     return res;
                 }
@@ -55,6 +111,27 @@ namespace csv
             friend std::ofstream& operator<<(std::ofstream& os, const Row &row);
     };
 
+    /*
+    ** Set of columns a parser should materialize, by index or by header
+    ** name. Columns left out are still validated but come back empty and
+    ** are never copied. An empty projection keeps every column.
+    */
+    class Projection
+    {
+    public:
+        Projection(void);
+
+    public:
+        Projection &column(unsigned int pos);
+        Projection &column(const std::string &name);
+        bool empty(void) const;
+        std::vector<bool> resolve(const std::vector<std::string> &header) const;
+
+    private:
+        std::vector<unsigned int> _indices;
+        std::vector<std::string> _names;
+    };
+
     enum DataType {
         eFILE = 0,
         ePURE = 1
@@ -64,8 +141,11 @@ namespace csv
     {
 
     public:
-        Parser(const std::string &, const DataType &type = eFILE, char sep = ',');
+        Parser(const std::string &, const DataType &type = eFILE, char sep = ',',
+               const Projection &columns = Projection());
         ~Parser(void);
+        Parser(const Parser &) = delete;
+        Parser &operator=(const Parser &) = delete;
 
     public:
         Row &getRow(unsigned int row) const;
@@ -89,12 +169,245 @@ namespace csv
         const DataType _type;
         const char _sep;
         std::vector<std::string> _originalFile;
-        std::vector<std::string> _header;
-        std::vector<Row *> _content;
+        Schema _schema;
+        std::vector<bool> _columns;
+        FieldBuffer _buffer;
+        // rows are handed out mutable from const getters, as they were
+        // when the parser held Row pointers
+        mutable std::vector<Row> _content;
 
     public:
         Row &operator[](unsigned int row) const;
     };
+
+    /*
+    ** Read-only memory mapping of a whole file. The mapping stays valid
+    ** for the lifetime of the object, so views into data() can be handed
+    ** out freely as long as the MappedFile outlives them.
+    */
+    class MappedFile
+    {
+    public:
+        MappedFile(const std::string &);
+        ~MappedFile(void);
+        MappedFile(const MappedFile &) = delete;
+        MappedFile &operator=(const MappedFile &) = delete;
+
+    public:
+        const char *data(void) const;
+        std::size_t size(void) const;
+        std::string_view view(void) const;
+
+    private:
+        const char *_data;
+        std::size_t _size;
+# ifdef _WIN32
+        void *_handle;
+        void *_mapping;
+# endif
+    };
+
+    /*
+    ** Zero-copy row: every value is a view into the buffer owned by the
+    ** parser that produced it. Values are the raw field text, quotes
+    ** included, exactly like Row.
+    */
+    class RowView
+    {
+    public:
+        RowView(const std::vector<std::string> &, const std::string_view *);
+
+    public:
+        unsigned int size(void) const;
+        std::string_view operator[](unsigned int) const;
+        std::string_view operator[](const std::string &valueName) const;
+
+        template<typename T>
+        const T getValue(unsigned int pos) const
+        {
+            if (pos < _header->size())
+            {
+                T res;
+                std::stringstream ss;
+                ss << _values[pos];
+                ss >> res;
+                return res;
+            }
+            throw Error("can't return this value (doesn't exist)");
+        }
+        friend std::ostream& operator<<(std::ostream& os, const RowView &row);
+
+    private:
+        const std::vector<std::string> *_header;
+        const std::string_view *_values;
+    };
+
+    /*
+    ** mmap-backed parser: the file is mapped once and every field is kept
+    ** as a std::string_view into the mapping, so loading costs a single
+    ** pass over the pages with no per-line or per-field copies. Unlike
+    ** Parser, a quoted field may span several lines. A compressed file
+    ** is inflated into memory once and parsed from there.
+    */
+    class MappedParser
+    {
+
+    public:
+        MappedParser(const std::string &, char sep = ',',
+                     const Projection &columns = Projection());
+        ~MappedParser(void);
+
+    public:
+        RowView getRow(unsigned int row) const;
+        unsigned int rowCount(void) const;
+        unsigned int columnCount(void) const;
+        std::vector<std::string> getHeader(void) const;
+        const std::string getHeaderElement(unsigned int pos) const;
+        const std::string &getFileName(void) const;
+
+    protected:
+        void parseHeader(void);
+        void parseContent(void);
+
+    private:
+        std::string _file;
+        const char _sep;
+        MappedFile _map;
+        std::string _inflated;
+        std::string_view _text;
+        const char *_cursor;
+        std::vector<std::string> _header;
+        std::vector<bool> _columns;
+        std::vector<std::string_view> _fields;
+
+    public:
+        RowView operator[](unsigned int row) const;
+    };
+
+    /*
+    ** Sequential byte source behind the parsers. A file that starts with
+    ** the gzip or zstd magic number is decompressed on the fly, a chunk
+    ** at a time, so compressed exports load without a temporary copy.
+    ** gzip needs the build to define CSV_HAVE_ZLIB (and link -lz), zstd
+    ** CSV_HAVE_ZSTD (and -lzstd); without them such files are refused.
+    */
+    class Input
+    {
+    public:
+        static std::unique_ptr<Input> open(const std::string &);
+        virtual ~Input(void);
+
+    public:
+        // up to `size` bytes; 0 only at the end of the data
+        virtual std::size_t read(char *, std::size_t size) = 0;
+        std::size_t fill(char *, std::size_t size);
+    };
+
+    /*
+    ** Streaming reader: the file is read `chunkSize` bytes at a time and
+    ** tokenized one record at a time, so memory stays bounded by the
+    ** chunk (or the longest record) no matter how large the file is.
+    ** The RowView handed out is only valid until the next call to next().
+    */
+    class Reader
+    {
+
+    public:
+        Reader(const std::string &, char sep = ',', std::size_t chunkSize = 1 << 20,
+               const Projection &columns = Projection());
+        ~Reader(void);
+
+    public:
+        bool next(void);
+        RowView row(void) const;
+        unsigned int columnCount(void) const;
+        const std::vector<std::string> &getHeader(void) const;
+        const std::string &getFileName(void) const;
+
+        template<typename F>
+        std::size_t forEachRow(F callback)
+        {
+            std::size_t count = 0;
+            while (next())
+            {
+                callback(row());
+                count++;
+            }
+            return count;
+        }
+
+    protected:
+        bool fill(void);
+        bool nextRecord(void);
+
+    private:
+        std::string _file;
+        const char _sep;
+        const std::size_t _chunkSize;
+        std::unique_ptr<Input> _input;
+        std::vector<char> _buffer;
+        std::size_t _begin;
+        std::size_t _end;
+        bool _eof;
+        std::vector<std::string> _header;
+        std::vector<bool> _columns;
+        std::vector<std::string_view> _fields;
+    };
+
+    /*
+    ** Pipelined reader: a reader thread pulls the file (through Input,
+    ** so decompressing it if need be) in `chunkSize` blocks and cuts
+    ** them at record boundaries, `workers` threads (0 = one per spare
+    ** core) tokenize the blocks concurrently, and the calling thread
+    ** takes the parsed batches back in file order. A fixed pool of
+    ** buffers circulates between the stages through bounded lock-free
+    ** queues, so reading overlaps with parsing while memory stays at
+    ** about 2 * workers + 2 chunks. A batch, and every RowView into it,
+    ** is valid until the next call to nextBatch(). A malformed record
+    ** throws from nextBatch() and the rest of its batch is dropped. The
+    ** reader must be used from the thread that built it.
+    */
+    class PipelinedReader
+    {
+
+    public:
+        PipelinedReader(const std::string &, char sep = ',',
+                        const Projection &columns = Projection(),
+                        unsigned int workers = 0, std::size_t chunkSize = 1 << 20);
+        ~PipelinedReader(void);
+        PipelinedReader(const PipelinedReader &) = delete;
+        PipelinedReader &operator=(const PipelinedReader &) = delete;
+
+    public:
+        bool nextBatch(void);
+        unsigned int rowCount(void) const;
+        RowView getRow(unsigned int row) const;
+        unsigned int columnCount(void) const;
+        const std::vector<std::string> &getHeader(void) const;
+        const std::string &getFileName(void) const;
+
+        template<typename F>
+        std::size_t forEachRow(F callback)
+        {
+            std::size_t count = 0;
+            while (nextBatch())
+            {
+                for (unsigned int i = 0; i != rowCount(); i++)
+                    callback(getRow(i));
+                count += rowCount();
+            }
+            return count;
+        }
+
+    private:
+        struct Pipeline;
+
+        std::string _file;
+        const char _sep;
+        std::vector<std::string> _header;
+        std::vector<bool> _columns;
+        std::unique_ptr<Pipeline> _pipeline;
+    };
 }
 
 #endif /*!_CSVPARSER_HPP_*/
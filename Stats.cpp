@@ -0,0 +1,157 @@
+//============================================================================
+// Name        : Stats.cpp
+// Description : Optional hot-path counters for the sorts and the parser
+//============================================================================
+
+#include "Stats.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <mutex>
+#include <new>
+
+using namespace std;
+
+namespace stats {
+
+const char* const COUNTER_NAMES[COUNTER_COUNT] = {
+    "comparisons", "swaps", "moves", "max depth", "bytes scanned", "rows parsed", "allocations", "allocated bytes"
+};
+
+Totals::Totals() {
+    fill(values, values + COUNTER_COUNT, 0);
+}
+
+#ifdef VECTORSORTING_STATS
+atomic<uint64_t> counters[COUNTER_COUNT];
+
+namespace {
+    mutex phaseLock; // Guards phaseList
+    vector<PhaseTotals> phaseList; // Recorded phases
+    thread_local uint64_t depth = 0; // Sort recursion depth on this thread
+}
+
+bool enabled() {
+    return true;
+}
+
+Totals current() {
+    Totals totals; // Copy of the counters
+    for (size_t i = 0; i < COUNTER_COUNT; i++) {
+        totals.values[i] = counters[i].load(memory_order_relaxed);
+    }
+    return totals;
+}
+
+vector<PhaseTotals> phases() {
+    lock_guard<mutex> guard(phaseLock);
+    return phaseList;
+}
+
+void reset() {
+    for (size_t i = 0; i < COUNTER_COUNT; i++) {
+        counters[i].store(0, memory_order_relaxed);
+    }
+    lock_guard<mutex> guard(phaseLock);
+    phaseList.clear();
+}
+
+/**
+ * Start a phase. MAX_DEPTH is cleared so the phase sees only its own
+ * deepest recursion; the old maximum is restored when it ends.
+ *
+ * @param name Phase to attribute the counts to
+ */
+Phase::Phase(const char* name) : name(name), start(current()) {
+    counters[MAX_DEPTH].store(0, memory_order_relaxed);
+}
+
+Phase::~Phase() {
+    Totals end = current(); // Counters as the phase ends
+    Totals delta; // What the phase added
+    for (size_t i = 0; i < COUNTER_COUNT; i++) {
+        delta.values[i] = end.values[i] - start.values[i];
+    }
+    delta.values[MAX_DEPTH] = end.values[MAX_DEPTH];
+    counters[MAX_DEPTH].store(max(start.values[MAX_DEPTH], end.values[MAX_DEPTH]), memory_order_relaxed);
+
+    lock_guard<mutex> guard(phaseLock);
+    auto found = find_if(phaseList.begin(), phaseList.end(),
+                         [this](const PhaseTotals& phase) { return phase.name == name; });
+    if (found == phaseList.end()) {
+        phaseList.push_back(PhaseTotals{ name, 0, Totals() });
+        found = phaseList.end() - 1;
+    }
+    found->runs++;
+    for (size_t i = 0; i < COUNTER_COUNT; i++) {
+        found->totals.values[i] = (i == MAX_DEPTH) ? max(found->totals.values[i], delta.values[i])
+                                                   : found->totals.values[i] + delta.values[i];
+    }
+}
+
+DepthGuard::DepthGuard() {
+    uint64_t now = ++depth; // Depth including this call
+    uint64_t seen = counters[MAX_DEPTH].load(memory_order_relaxed);
+    while (now > seen && !counters[MAX_DEPTH].compare_exchange_weak(seen, now, memory_order_relaxed)) {
+        // seen was reloaded; try again while we are deeper
+    }
+}
+
+DepthGuard::~DepthGuard() {
+    --depth;
+}
+#else
+bool enabled() {
+    return false;
+}
+
+Totals current() {
+    return Totals();
+}
+
+vector<PhaseTotals> phases() {
+    return vector<PhaseTotals>();
+}
+
+void reset() {}
+
+Phase::Phase(const char* name) : name(name) {}
+
+Phase::~Phase() {}
+#endif
+
+}
+
+#ifdef VECTORSORTING_STATS
+// Counting replacements for the global allocation functions. The nothrow
+// forms forward to these; over-aligned allocations are not counted.
+void* operator new(size_t size) {
+    stats::add(stats::ALLOCATIONS, 1);
+    stats::add(stats::ALLOCATED_BYTES, size);
+    void* memory = malloc(size == 0 ? 1 : size);
+    if (memory == nullptr) {
+        throw bad_alloc();
+    }
+    return memory;
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void* memory) noexcept {
+    free(memory);
+}
+
+void operator delete[](void* memory) noexcept {
+    free(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept {
+    free(memory);
+}
+
+void operator delete[](void* memory, size_t) noexcept {
+    free(memory);
+}
+#endif
@@ -0,0 +1,101 @@
+//============================================================================
+// Name        : Stats.hpp
+// Description : Optional hot-path counters for the sorts and the parser
+//============================================================================
+
+#ifndef STATS_HPP
+#define STATS_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Counters are compiled in only when building with -DVECTORSORTING_STATS.
+// Otherwise every STATS_ macro expands to nothing and the API below
+// reports that statistics are off.
+namespace stats {
+
+enum Counter {
+    COMPARISONS, // Calls to an order's compare
+    SWAPS, // Two bids exchanged
+    MOVES, // One bid copied into place
+    MAX_DEPTH, // Deepest sort recursion seen (a maximum, not a sum)
+    BYTES_SCANNED, // CSV bytes split into fields
+    ROWS_PARSED, // CSV records produced
+    ALLOCATIONS, // Calls to operator new
+    ALLOCATED_BYTES, // Bytes asked of operator new
+    COUNTER_COUNT
+};
+
+extern const char* const COUNTER_NAMES[COUNTER_COUNT];
+
+// Value of every counter at one moment, or over one phase
+struct Totals {
+    uint64_t values[COUNTER_COUNT];
+
+    Totals();
+};
+
+// Counts accumulated under one phase name
+struct PhaseTotals {
+    std::string name; // As given to Phase
+    uint64_t runs; // Phases recorded under this name
+    Totals totals; // Their counts added up
+};
+
+// Whether the counters were compiled in
+bool enabled();
+
+// Counters since start-up or the last reset
+Totals current();
+
+// Per-phase counts, in the order the phases first ran
+std::vector<PhaseTotals> phases();
+
+// Zero the counters and forget the phases
+void reset();
+
+// Attributes the counts made during its lifetime to a named phase.
+// Phases on different threads or nested in each other are not told apart.
+class Phase {
+public:
+    explicit Phase(const char* name);
+    ~Phase();
+
+    Phase(const Phase&) = delete;
+    Phase& operator=(const Phase&) = delete;
+
+private:
+    const char* name; // Phase the counts go to
+    Totals start; // Counters when the phase began
+};
+
+#ifdef VECTORSORTING_STATS
+extern std::atomic<uint64_t> counters[COUNTER_COUNT];
+
+inline void add(Counter counter, uint64_t amount) {
+    counters[counter].fetch_add(amount, std::memory_order_relaxed);
+}
+
+// Tracks recursion depth on this thread and raises MAX_DEPTH
+class DepthGuard {
+public:
+    DepthGuard();
+    ~DepthGuard();
+};
+#endif
+
+}
+
+#ifdef VECTORSORTING_STATS
+#define STATS_ADD(counter, amount) stats::add(stats::counter, (amount))
+#define STATS_DEPTH() stats::DepthGuard statsDepthGuard
+#define STATS_PHASE(name) stats::Phase statsPhase(name)
+#else
+#define STATS_ADD(counter, amount) ((void)0)
+#define STATS_DEPTH() ((void)0)
+#define STATS_PHASE(name) ((void)0)
+#endif
+
+#endif
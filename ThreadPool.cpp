@@ -0,0 +1,187 @@
+//============================================================================
+// Name        : ThreadPool.cpp
+// Description : Work-stealing thread pool used by the parallel sorts
+//============================================================================
+
+#include "ThreadPool.hpp"
+
+using namespace std;
+
+namespace {
+    // Pool and queue index of the worker running on this thread, if any
+    thread_local const ThreadPool* currentPool = nullptr;
+    thread_local size_t currentIndex = 0;
+}
+
+/**
+ * Start the worker threads.
+ *
+ * @param threads Number of workers; 0 means one per hardware thread
+ */
+ThreadPool::ThreadPool(unsigned int threads) : pending(0), stopping(false) {
+    if (threads == 0) {
+        threads = max(1u, thread::hardware_concurrency());
+    }
+    for (unsigned int i = 0; i <= threads; i++) {
+        queues.emplace_back(new Queue()); // The extra queue takes outside submissions
+    }
+    for (unsigned int i = 0; i < threads; i++) {
+        workers.emplace_back(&ThreadPool::workerLoop, this, i);
+    }
+}
+
+/**
+ * Stop the workers. Tasks still queued are dropped.
+ */
+ThreadPool::~ThreadPool() {
+    {
+        lock_guard<mutex> guard(sleepLock);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (size_t i = 0; i < workers.size(); i++) {
+        workers[i].join();
+    }
+}
+
+unsigned int ThreadPool::size() const {
+    return static_cast<unsigned int>(workers.size());
+}
+
+/**
+ * Queue a task, preferring the calling worker's own deque.
+ *
+ * @param task The task to run
+ */
+void ThreadPool::submit(function<void()> task) {
+    size_t index = (currentPool == this) ? currentIndex : workers.size();
+    {
+        lock_guard<mutex> guard(queues[index]->lock);
+        queues[index]->tasks.push_back(move(task));
+    }
+    {
+        // Taking the lock orders this against a worker about to sleep
+        lock_guard<mutex> guard(sleepLock);
+        pending++;
+    }
+    wake.notify_one();
+}
+
+/**
+ * Run one pending task on the calling thread.
+ *
+ * @return true if a task was run
+ */
+bool ThreadPool::runOne() {
+    size_t self = (currentPool == this) ? currentIndex : workers.size();
+    function<void()> task; // Task taken from a queue
+    if (!popTask(self, task)) {
+        return false;
+    }
+    task();
+    return true;
+}
+
+/**
+ * Take the newest task from our own queue, or steal the oldest task from
+ * another one.
+ *
+ * @param self Index of the caller's own queue
+ * @param task Receives the task
+ * @return true if a task was found
+ */
+bool ThreadPool::popTask(size_t self, function<void()>& task) {
+    {
+        Queue& own = *queues[self];
+        lock_guard<mutex> guard(own.lock);
+        if (!own.tasks.empty()) {
+            task = move(own.tasks.back());
+            own.tasks.pop_back();
+            pending--;
+            return true;
+        }
+    }
+    for (size_t step = 1; step < queues.size(); step++) {
+        Queue& victim = *queues[(self + step) % queues.size()];
+        lock_guard<mutex> guard(victim.lock);
+        if (!victim.tasks.empty()) {
+            task = move(victim.tasks.front());
+            victim.tasks.pop_front();
+            pending--;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Body of each worker thread: run tasks until the pool stops, sleeping
+ * while there is nothing to do.
+ *
+ * @param index The worker's queue index
+ */
+void ThreadPool::workerLoop(size_t index) {
+    currentPool = this;
+    currentIndex = index;
+
+    function<void()> task; // Task being run
+    while (true) {
+        if (popTask(index, task)) {
+            task();
+            task = nullptr; // Release captures before sleeping
+            continue;
+        }
+        unique_lock<mutex> guard(sleepLock);
+        wake.wait(guard, [this] { return stopping || pending > 0; });
+        if (stopping) {
+            return;
+        }
+    }
+}
+
+TaskGroup::TaskGroup(ThreadPool& pool) : pool(pool), outstanding(0) {}
+
+TaskGroup::~TaskGroup() {
+    // Never leave tasks running that refer to this group
+    while (outstanding > 0) {
+        if (!pool.runOne()) {
+            this_thread::yield();
+        }
+    }
+}
+
+/**
+ * Run a task on the pool as part of this group.
+ *
+ * @param task The task to run
+ */
+void TaskGroup::run(function<void()> task) {
+    outstanding++;
+    pool.submit([this, task]() {
+        try {
+            task();
+        } catch (...) {
+            lock_guard<mutex> guard(errorLock);
+            if (!error) {
+                error = current_exception();
+            }
+        }
+        outstanding--;
+    });
+}
+
+/**
+ * Wait for every task in the group, helping to run queued tasks meanwhile.
+ */
+void TaskGroup::wait() {
+    while (outstanding > 0) {
+        if (!pool.runOne()) {
+            this_thread::yield();
+        }
+    }
+    if (error) {
+        exception_ptr failure = error;
+        error = nullptr;
+        rethrow_exception(failure);
+    }
+}
@@ -0,0 +1,77 @@
+//============================================================================
+// Name        : ThreadPool.hpp
+// Description : Work-stealing thread pool used by the parallel sorts
+//============================================================================
+
+#ifndef THREADPOOL_HPP
+#define THREADPOOL_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A fixed set of worker threads, each with its own task deque. A worker
+// runs its newest task first (good locality for divide and conquer) and,
+// when it runs dry, steals the oldest task from another worker.
+class ThreadPool {
+public:
+    // Start the given number of workers; 0 means one per hardware thread
+    explicit ThreadPool(unsigned int threads = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Number of worker threads
+    unsigned int size() const;
+
+    // Queue a task. Tasks submitted from a worker go to that worker's deque.
+    void submit(std::function<void()> task);
+
+    // Run one pending task on the calling thread, if there is one
+    bool runOne();
+
+private:
+    struct Queue {
+        std::mutex lock; // Guards tasks
+        std::deque<std::function<void()>> tasks; // Newest task at the back
+    };
+
+    bool popTask(size_t self, std::function<void()>& task);
+    void workerLoop(size_t index);
+
+    std::vector<std::unique_ptr<Queue>> queues; // One per worker, plus one for outside submitters
+    std::vector<std::thread> workers; // The worker threads
+    std::atomic<size_t> pending; // Tasks queued but not yet started
+    std::atomic<bool> stopping; // Set once the pool shuts down
+    std::mutex sleepLock; // Guards the sleep/wake handshake
+    std::condition_variable wake; // Signalled when work arrives or on shutdown
+};
+
+// Fork-join helper: tasks run on the pool, and wait() returns once every
+// task in the group (including ones added by tasks) has finished. The
+// waiting thread runs pending tasks instead of blocking, so groups can
+// nest. The first exception thrown by a task is rethrown from wait().
+class TaskGroup {
+public:
+    explicit TaskGroup(ThreadPool& pool);
+    ~TaskGroup();
+
+    void run(std::function<void()> task);
+    void wait();
+
+private:
+    ThreadPool& pool; // Pool the tasks run on
+    std::atomic<size_t> outstanding; // Tasks not yet finished
+    std::mutex errorLock; // Guards error
+    std::exception_ptr error; // First failure, if any
+};
+
+#endif // THREADPOOL_HPP
@@ -7,9 +7,29 @@
 //============================================================================
 
 #include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
 #include <iostream>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string_view>
+#include <thread>
 #include <time.h>
+#include <unordered_map>
 #include "CSVparser.hpp"
+#include "Stats.hpp"
+#include "ThreadPool.hpp"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 using namespace std;
 
@@ -17,18 +37,753 @@ using namespace std;
 // Global definitions visible to all methods and classes
 //============================================================================
 
-// Forward declaration of a helper function to convert strings to doubles
-double strToDouble(string str, char ch);
+// Forward declaration of helper functions to parse money and date fields
+bool parseMoney(string_view field, double& value);
+bool parseDate(string_view field, uint32_t& date);
+
+// Append-only storage for string bytes. Text is copied into large blocks
+// that never move, so the views handed out stay valid until clear(), or
+// until a rewind() to a mark taken before them.
+class StringArena {
+public:
+    // Fill level to rewind to
+    struct Mark {
+        size_t blocks; // Blocks allocated when the mark was taken
+        size_t large; // Oversized blocks likewise
+        size_t used; // Bytes used in the last block
+    };
+
+    StringArena() : used(BLOCK_SIZE) {}
+
+    // Copy text into the arena and return a view of the copy
+    string_view store(string_view text) {
+        if (text.empty()) {
+            return string_view();
+        }
+        if (text.size() > BLOCK_SIZE) {
+            // Oversized strings get a block of their own; the current block stays in use
+            large.emplace_back(new char[text.size()]);
+            memcpy(large.back().get(), text.data(), text.size());
+            return string_view(large.back().get(), text.size());
+        }
+        if (text.size() > BLOCK_SIZE - used) {
+            blocks.emplace_back(new char[BLOCK_SIZE]);
+            used = 0;
+        }
+        char* dest = blocks.back().get() + used;
+        memcpy(dest, text.data(), text.size());
+        used += text.size();
+        return string_view(dest, text.size());
+    }
+
+    void clear() {
+        blocks.clear();
+        large.clear();
+        used = BLOCK_SIZE;
+    }
+
+    Mark mark() const { return Mark{ blocks.size(), large.size(), used }; }
+
+    // Drop every string stored since the mark was taken
+    void rewind(const Mark& mark) {
+        blocks.resize(mark.blocks);
+        large.resize(mark.large);
+        used = mark.used;
+    }
+
+private:
+    static constexpr size_t BLOCK_SIZE = 64 * 1024; // Bytes per arena block
+    vector<unique_ptr<char[]>> blocks; // Blocks in allocation order
+    vector<unique_ptr<char[]>> large; // One block per string over BLOCK_SIZE
+    size_t used; // Bytes used in the last block
+};
+
+// Interns low-cardinality strings (fund names and the like) as small
+// integer IDs. Each distinct string is stored once.
+class StringPool {
+public:
+    // Return the ID of text, adding it to the pool on first sight
+    uint32_t intern(string_view text) {
+        auto found = ids.find(text);
+        if (found != ids.end()) {
+            return found->second;
+        }
+        uint32_t id = static_cast<uint32_t>(names.size());
+        string_view stored = arena.store(text);
+        names.push_back(stored);
+        ids.emplace(stored, id);
+        return id;
+    }
+
+    string_view name(uint32_t id) const { return names[id]; }
+    size_t size() const { return names.size(); }
+
+    void clear() {
+        ids.clear();
+        names.clear();
+        arena.clear();
+    }
+
+private:
+    StringArena arena; // Backing bytes for the names
+    unordered_map<string_view, uint32_t> ids; // Name to ID lookup
+    vector<string_view> names; // ID to name lookup
+};
 
-// Structure to hold bid information
+// Structure to hold bid information. The strings are views into the
+// BidStore the bid was loaded into and live as long as that store.
 struct Bid {
-    string bidId; // Unique identifier for the bid
-    string title;  // Title of the bid
-    string fund;   // Fund associated with the bid
+    string_view bidId; // Unique identifier for the bid
+    string_view title;  // Title of the bid
+    string_view fund;   // Fund associated with the bid (interned)
+    uint32_t fundId; // ID of the fund in BidStore::funds
     double amount; // Monetary amount of the bid
+    uint64_t titleKey; // First 8 bytes of the title, big-endian (see titlePrefix)
+    uint32_t closeDate; // Close date as yyyymmdd, 0 if unknown
 
     // Constructor to initialize the bid amount
-    Bid() : amount(0.0) {}
+    Bid() : fundId(0), amount(0.0), titleKey(0), closeDate(0) {}
+};
+
+// Pack the first 8 bytes of a title big-endian and zero padded, so that
+// comparing two prefixes as integers orders them like the titles.
+inline uint64_t titlePrefix(string_view title) {
+    uint64_t key = 0;
+    for (size_t i = 0; i < 8; i++) {
+        key <<= 8;
+        if (i < title.size()) {
+            key |= static_cast<unsigned char>(title[i]);
+        }
+    }
+    return key;
+}
+
+// Title order: one integer compare, then the full strings only on a tie
+inline bool titleLess(const Bid& a, const Bid& b) {
+    if (a.titleKey != b.titleKey) {
+        return a.titleKey < b.titleKey;
+    }
+    return a.title < b.title;
+}
+
+// Three-way title comparison: negative, zero or positive
+inline int compareTitles(const Bid& a, const Bid& b) {
+    if (a.titleKey != b.titleKey) {
+        return (a.titleKey < b.titleKey) ? -1 : 1;
+    }
+    return a.title.compare(b.title);
+}
+
+// Sort keys. Each key is a type with a static three-way compare, and
+// OrderBy<...> chains them: the first key that tells two bids apart
+// decides. The sorts take the order as a template parameter, so the whole
+// chain is inlined with no function pointer or std::function in between.
+struct ByTitle {
+    static int compare(const Bid& a, const Bid& b) { return compareTitles(a, b); }
+};
+
+struct ByAuctionId {
+    static int compare(const Bid& a, const Bid& b) { return a.bidId.compare(b.bidId); }
+};
+
+struct ByFund {
+    static int compare(const Bid& a, const Bid& b) {
+        if (a.fundId == b.fundId) {
+            return 0; // Same interned fund; no need to look at the names
+        }
+        return a.fund.compare(b.fund);
+    }
+};
+
+struct ByAmount {
+    static int compare(const Bid& a, const Bid& b) {
+        return (b.amount < a.amount) - (a.amount < b.amount);
+    }
+};
+
+// Reverses a key, e.g. Descending<ByAmount> for highest amounts first
+template <typename Key>
+struct Descending {
+    static int compare(const Bid& a, const Bid& b) { return Key::compare(b, a); }
+};
+
+template <typename... Keys>
+struct OrderBy {
+    // Three-way comparison: negative, zero or positive
+    int compare(const Bid& a, const Bid& b) const {
+        STATS_ADD(COMPARISONS, 1);
+        int result = 0;
+        (void)(((result = Keys::compare(a, b)) != 0) || ...); // Stop at the first difference
+        return result;
+    }
+
+    // Strict weak ordering for the two-way sorts
+    bool operator()(const Bid& a, const Bid& b) const { return compare(a, b) < 0; }
+};
+
+typedef OrderBy<ByTitle> TitleOrder; // The default order of every sort
+
+// Order on a string field past a prefix every bid being sorted shares,
+// for finishing a radix sort that has distributed on the first bytes
+struct SuffixOrder {
+    SuffixOrder(string_view Bid::* key, size_t depth) : key(key), depth(depth) {}
+
+    int compare(const Bid& a, const Bid& b) const {
+        STATS_ADD(COMPARISONS, 1);
+        return suffix(a).compare(suffix(b));
+    }
+
+    bool operator()(const Bid& a, const Bid& b) const { return compare(a, b) < 0; }
+
+private:
+    string_view suffix(const Bid& bid) const {
+        string_view text = bid.*key;
+        return text.substr(min(depth, text.size()));
+    }
+
+    string_view Bid::* key; // The field sorted on
+    size_t depth; // Leading bytes known to be equal
+};
+
+// Read-only view of bids in a sorted order, given as a permutation of
+// their positions. Reading through the view never moves a Bid.
+struct BidView {
+    const vector<Bid>* bids; // The bids in their stored order
+    const vector<uint32_t>* order; // order[i] is the position of the i-th bid
+
+    BidView(const vector<Bid>& bids, const vector<uint32_t>& order) : bids(&bids), order(&order) {}
+
+    size_t size() const { return order->size(); }
+    const Bid& operator[](size_t i) const { return (*bids)[(*order)[i]]; }
+};
+
+// Open-addressing hash index from auction ID to position in a bid
+// vector. Each slot is 8 bytes (hash fingerprint and position) and
+// probing is linear, so a lookup usually touches one cache line of the
+// table plus the bid it finds. The index does not own the bids; any
+// reorder of the vector makes it stale and it must be cleared. With
+// duplicate IDs only the first bid is indexed.
+class BidIndex {
+public:
+    static constexpr size_t NOT_FOUND = size_t(-1); // Result of a failed find
+
+    BidIndex() : live(0), used(0) {}
+
+    bool empty() const { return slots.empty(); }
+    size_t size() const { return live; }
+
+    // Drop every entry, e.g. after the bids were sorted
+    void clear() {
+        slots.clear();
+        live = 0;
+        used = 0;
+    }
+
+    // Index every bid, replacing whatever was indexed before
+    void build(const vector<Bid>& bids) {
+        clear();
+        rehash(bids.size());
+        for (size_t i = 0; i < bids.size(); i++) {
+            insert(bids, i);
+        }
+    }
+
+    // Position of the bid with this ID, or NOT_FOUND
+    size_t find(const vector<Bid>& bids, string_view bidId) const {
+        if (slots.empty()) {
+            return NOT_FOUND;
+        }
+        size_t slot = locate(bids, bidId, fingerprint(bidId));
+        return slots[slot].position < TOMBSTONE ? slots[slot].position : NOT_FOUND;
+    }
+
+    // Index bids[position]; false if its ID was already indexed
+    bool insert(const vector<Bid>& bids, size_t position) {
+        if (2 * (used + 1) > slots.size()) {
+            rehash(live + 1); // Keep at least half the slots empty
+        }
+        uint32_t hash = fingerprint(bids[position].bidId);
+        size_t slot = locate(bids, bids[position].bidId, hash);
+        if (slots[slot].position < TOMBSTONE) {
+            return false;
+        }
+        if (slots[slot].position == EMPTY) {
+            used++;
+        }
+        slots[slot].hash = hash;
+        slots[slot].position = static_cast<uint32_t>(position);
+        live++;
+        return true;
+    }
+
+    // Forget the bid with this ID; false if it wasn't indexed
+    bool erase(const vector<Bid>& bids, string_view bidId) {
+        if (slots.empty()) {
+            return false;
+        }
+        size_t slot = locate(bids, bidId, fingerprint(bidId));
+        if (slots[slot].position >= TOMBSTONE) {
+            return false;
+        }
+        slots[slot].position = TOMBSTONE; // Keeps later probes connected
+        live--;
+        return true;
+    }
+
+    // Point the entry for bids[to]'s ID at position to, after a move
+    void moved(const vector<Bid>& bids, size_t to) {
+        size_t slot = locate(bids, bids[to].bidId, fingerprint(bids[to].bidId));
+        if (slots[slot].position < TOMBSTONE) {
+            slots[slot].position = static_cast<uint32_t>(to);
+        }
+    }
+
+private:
+    static constexpr uint32_t EMPTY = 0xFFFFFFFF; // Slot never used
+    static constexpr uint32_t TOMBSTONE = 0xFFFFFFFE; // Slot whose entry was erased
+
+    struct Slot {
+        uint32_t hash; // Low bits of the ID's hash, checked before the ID
+        uint32_t position; // Index into the bids, EMPTY or TOMBSTONE
+    };
+
+    static uint32_t fingerprint(string_view bidId) {
+        return static_cast<uint32_t>(std::hash<string_view>()(bidId));
+    }
+
+    // Slot holding bidId, or else the first free slot on its probe path
+    size_t locate(const vector<Bid>& bids, string_view bidId, uint32_t hash) const {
+        size_t mask = slots.size() - 1; // Table size is a power of two
+        size_t free = NOT_FOUND; // First tombstone seen, reused for inserts
+        for (size_t slot = hash & mask; ; slot = (slot + 1) & mask) {
+            const Slot& entry = slots[slot];
+            if (entry.position == EMPTY) {
+                return free != NOT_FOUND ? free : slot;
+            }
+            if (entry.position == TOMBSTONE) {
+                if (free == NOT_FOUND) {
+                    free = slot;
+                }
+            } else if (entry.hash == hash && bids[entry.position].bidId == bidId) {
+                return slot;
+            }
+        }
+    }
+
+    // Resize for count entries, dropping tombstones on the way
+    void rehash(size_t count) {
+        size_t capacity = 16; // Smallest table
+        while (capacity < 2 * count + 2) {
+            capacity *= 2;
+        }
+        vector<Slot> old(capacity, Slot{ 0, EMPTY });
+        old.swap(slots);
+        used = live;
+        for (const Slot& entry : old) {
+            if (entry.position < TOMBSTONE) {
+                size_t slot = entry.hash & (slots.size() - 1);
+                while (slots[slot].position != EMPTY) {
+                    slot = (slot + 1) & (slots.size() - 1);
+                }
+                slots[slot] = entry;
+            }
+        }
+    }
+
+    vector<Slot> slots; // The table
+    size_t live; // Slots holding an entry
+    size_t used; // Slots holding an entry or a tombstone
+};
+
+vector<uint32_t> lsdRadixOrder(const vector<uint64_t>& keys);
+uint64_t amountKey(double amount);
+
+// Sorted secondary index: bid positions ordered by a 64-bit key, with
+// the keys alongside so a range is two binary searches away.
+struct RangeIndex {
+    vector<uint64_t> keys; // Keys in ascending order
+    vector<uint32_t> positions; // positions[i] is the bid holding keys[i]
+
+    bool empty() const { return positions.empty(); }
+
+    void clear() {
+        keys.clear();
+        positions.clear();
+    }
+
+    // Index bids by key(bid), which must preserve the wanted order
+    template <typename KeyOf>
+    void build(const vector<Bid>& bids, KeyOf key) {
+        vector<uint64_t> unsorted(bids.size()); // Key of each bid, in bid order
+        for (size_t i = 0; i < bids.size(); i++) {
+            unsorted[i] = key(bids[i]);
+        }
+        positions = lsdRadixOrder(unsorted);
+        keys.resize(positions.size());
+        for (size_t i = 0; i < positions.size(); i++) {
+            keys[i] = unsorted[positions[i]];
+        }
+    }
+
+    // Range [first, last) of positions whose keys lie in [low, high]
+    pair<size_t, size_t> range(uint64_t low, uint64_t high) const {
+        size_t first = lower_bound(keys.begin(), keys.end(), low) - keys.begin();
+        size_t last = upper_bound(keys.begin() + first, keys.end(), high) - keys.begin();
+        return make_pair(first, max(first, last));
+    }
+};
+
+// A set of bids together with the storage their strings point into.
+// Move-only: moving keeps every view valid since the blocks stay put.
+struct BidStore {
+    vector<Bid> bids; // The bids, in load or sort order
+    StringArena strings; // Bytes of bid IDs and titles
+    StringPool funds; // Distinct fund names
+    unique_ptr<csv::MappedFile> snapshot; // Mapped snapshot the bid strings may point into
+    BidIndex byId; // Built on the first lookup, cleared when bids move
+    RangeIndex byAmount; // Built on the first range query, cleared when bids move
+    RangeIndex byCloseDate; // Likewise
+    bool sortedByTitle; // Whether bids are known to be in TitleOrder
+
+    BidStore() : sortedByTitle(false) {}
+
+    void clear() {
+        bids.clear();
+        strings.clear();
+        funds.clear();
+        snapshot.reset();
+        dropIndexes();
+        sortedByTitle = false;
+    }
+
+    // Forget every index, e.g. after the bids were loaded or sorted
+    void dropIndexes() {
+        byId.clear();
+        byAmount.clear();
+        byCloseDate.clear();
+    }
+};
+
+// Formats bids as display lines into one large buffer and hands it to
+// the stream only when full, so a long listing costs a few big writes
+// instead of a flush per line. Lines match displayBid exactly.
+class BidWriter {
+public:
+    explicit BidWriter(ostream& out, size_t capacity = 1 << 18)
+        : out(out), buffer(max<size_t>(capacity, MAX_NUMBER)), used(0) {}
+
+    BidWriter(const BidWriter&) = delete;
+    BidWriter& operator=(const BidWriter&) = delete;
+    ~BidWriter() { flush(); }
+
+    // Format one bid as "ID: title | amount | fund"
+    void write(const Bid& bid) {
+        append(bid.bidId);
+        append(": ");
+        append(bid.title);
+        append(" | ");
+        if (buffer.size() - used < MAX_NUMBER) {
+            flush();
+        }
+        // Six significant digits, as operator<< prints a double
+        char* end = buffer.data() + buffer.size();
+        used = to_chars(buffer.data() + used, end, bid.amount, chars_format::general, 6).ptr - buffer.data();
+        append(" | ");
+        append(bid.fund);
+        append("\n");
+    }
+
+    // Hand everything buffered so far to the stream
+    void flush() {
+        if (used != 0) {
+            out.write(buffer.data(), used);
+            used = 0;
+        }
+        out.flush();
+    }
+
+private:
+    void append(string_view text) {
+        if (text.empty()) {
+            return; // May be a null view from the arena; nothing to copy
+        }
+        if (text.size() > buffer.size() - used) {
+            flush();
+            if (text.size() > buffer.size()) {
+                out.write(text.data(), text.size()); // Too big to be worth copying
+                return;
+            }
+        }
+        memcpy(buffer.data() + used, text.data(), text.size());
+        used += text.size();
+    }
+
+    static constexpr size_t MAX_NUMBER = 32; // Room needed to format an amount
+    ostream& out; // Where full buffers go
+    vector<char> buffer; // Formatted lines not yet written
+    size_t used; // Bytes of buffer in use
+};
+
+// Fixed header at the start of a bid snapshot. The sections follow in
+// this order, each starting on an 8-byte boundary:
+//   uint64 stringOffsets[2 * count + 1]  bid i's ID is blob[off[2i], off[2i+1]),
+//                                        its title blob[off[2i+1], off[2i+2])
+//   uint64 fundOffsets[fundCount + 1]    fund names, also in blob
+//   uint64 titleKeys[count]
+//   double amounts[count]
+//   uint32 fundIds[count]
+//   uint32 closeDates[count]
+//   char   blob[blobSize]
+struct SnapshotHeader {
+    char magic[8]; // SNAPSHOT_MAGIC
+    uint32_t version; // SNAPSHOT_VERSION
+    uint32_t byteOrder; // SNAPSHOT_BYTE_ORDER as written by the saving machine
+    uint32_t flags; // SNAPSHOT_SORTED_BY_TITLE and friends
+    uint32_t reserved; // Zero
+    uint64_t count; // Number of bids
+    uint64_t fundCount; // Number of distinct funds
+    uint64_t blobSize; // Bytes of string data
+    uint64_t padding[2]; // Zero; rounds the header up to 64 bytes
+};
+
+static const char SNAPSHOT_MAGIC[8] = { 'B', 'I', 'D', 'S', 'N', 'A', 'P', '\0' };
+static const uint32_t SNAPSHOT_VERSION = 2; // Bump on any layout change
+static const uint32_t SNAPSHOT_BYTE_ORDER = 0x01020304; // Reads differently on a foreign machine
+static const uint32_t SNAPSHOT_SORTED_BY_TITLE = 1; // Bids were saved in TitleOrder
+
+// Column store of bids for scans that touch only a few fields. Each
+// field is its own contiguous array, so summing amounts streams through
+// amounts and fundIds alone; titles and IDs live in one blob each.
+struct BidTable {
+    vector<double> amounts; // Amount of each bid
+    vector<uint32_t> fundIds; // Fund of each bid, an ID in funds
+    vector<uint32_t> closeDates; // Close date of each bid as yyyymmdd
+    vector<uint64_t> titleOffsets; // Title i is titles[titleOffsets[i], titleOffsets[i + 1])
+    string titles; // Bytes of all titles
+    vector<uint64_t> idOffsets; // Likewise for the auction IDs
+    string ids; // Bytes of all auction IDs
+    vector<uint32_t> departmentIds; // Department of each bid, an ID in departments
+    vector<double> ccFees; // CC Fee of each bid, NaN where the file has no such column
+    vector<double> feeTotals; // Auction Fee Total, likewise
+    vector<double> netSales; // Net Sales, likewise
+    StringPool funds; // Distinct fund names
+    StringPool departments; // Distinct department names
+
+    BidTable() : titleOffsets(1, 0), idOffsets(1, 0) {}
+
+    size_t size() const { return amounts.size(); }
+
+    string_view title(size_t i) const {
+        return string_view(titles).substr(titleOffsets[i], titleOffsets[i + 1] - titleOffsets[i]);
+    }
+
+    string_view bidId(size_t i) const {
+        return string_view(ids).substr(idOffsets[i], idOffsets[i + 1] - idOffsets[i]);
+    }
+
+    void clear() {
+        amounts.clear();
+        fundIds.clear();
+        closeDates.clear();
+        titleOffsets.assign(1, 0);
+        titles.clear();
+        idOffsets.assign(1, 0);
+        ids.clear();
+        departmentIds.clear();
+        ccFees.clear();
+        feeTotals.clear();
+        netSales.clear();
+        funds.clear();
+        departments.clear();
+    }
+};
+
+// Result of an aggregate over some bids' amounts
+struct AmountTotals {
+    double sum; // Total amount
+    double min; // Smallest amount
+    double max; // Largest amount
+    size_t count; // Number of bids
+
+    AmountTotals() : sum(0.0), min(HUGE_VAL), max(-HUGE_VAL), count(0) {}
+
+    // Count one value; NaN marks a missing value and is skipped
+    void add(double value) {
+        if (value != value) {
+            return;
+        }
+        sum += value;
+        min = std::min(min, value);
+        max = std::max(max, value);
+        count++;
+    }
+
+    void add(const AmountTotals& other) {
+        sum += other.sum;
+        min = std::min(min, other.min);
+        max = std::max(max, other.max);
+        count += other.count;
+    }
+};
+
+// Amount columns of a BidTable that groupTotals aggregates
+static const size_t MEASURE_COUNT = 4;
+static const char* const MEASURE_NAMES[MEASURE_COUNT] = { "Winning Bid", "CC Fee", "Auction Fee Total", "Net Sales" };
+
+// Totals of one group: its row count and each measure in MEASURE_NAMES order
+struct GroupTotals {
+    size_t rows; // Bids in the group
+    AmountTotals measures[MEASURE_COUNT]; // Totals of each measure
+
+    GroupTotals() : rows(0) {}
+
+    void add(const GroupTotals& other) {
+        rows += other.rows;
+        for (size_t m = 0; m < MEASURE_COUNT; m++) {
+            measures[m].add(other.measures[m]);
+        }
+    }
+};
+
+// Settings for externalSort
+struct ExternalSortOptions {
+    size_t memoryBudget; // Bytes of bids held in memory per run
+    string tempDir; // Where the sorted runs are spilled
+
+    ExternalSortOptions() : memoryBudget(64 << 20), tempDir(".") {}
+};
+
+// Temporary run files, removed when the set goes out of scope
+struct TempRuns {
+    vector<string> paths; // Runs in the order they were written
+
+    TempRuns() = default;
+    TempRuns(const TempRuns&) = delete;
+    TempRuns& operator=(const TempRuns&) = delete;
+    ~TempRuns() { removeAll(); }
+
+    void removeAll() {
+        for (const string& path : paths) {
+            error_code ignored; // Best effort; the run may never have been created
+            filesystem::remove(path, ignored);
+        }
+        paths.clear();
+    }
+};
+
+// Reads back one spilled run a bid at a time. The current bid's strings
+// are owned by the reader and change on every next(), except the fund,
+// which is interned in a pool shared by every run of the sort so fund
+// IDs compare the same across runs.
+class RunReader {
+public:
+    RunReader(const string& path, StringPool& funds) : buffer(1 << 16), funds(funds), exhausted(false) {
+        input.rdbuf()->pubsetbuf(buffer.data(), buffer.size());
+        input.open(path, ios::binary);
+        if (!input) {
+            throw runtime_error("cannot open run " + path);
+        }
+        next();
+    }
+
+    RunReader(const RunReader&) = delete;
+    RunReader& operator=(const RunReader&) = delete;
+
+    // Move to the next bid in the run; false once the run is used up
+    bool next();
+
+    const Bid& bid() const { return current; }
+    bool done() const { return exhausted; }
+
+private:
+    bool readString(string& text);
+
+    vector<char> buffer; // Stream buffer, set before the file is opened
+    ifstream input; // The run file
+    StringPool& funds; // Fund names shared by every run of the sort
+    string bidId; // Storage for current.bidId
+    string title; // Storage for current.title
+    string fund; // The fund as read, before interning
+    Bid current; // The bid at the front of the run
+    bool exhausted; // Whether the run has no bids left
+};
+
+// Tournament tree of losers over k runs. The root holds the run whose
+// bid comes first; after that run advances, only the path from its leaf
+// to the root is replayed, which takes log2(k) comparisons. Ties go to
+// the lower run index so the merge is stable across runs.
+template <typename Order>
+class LoserTree {
+public:
+    LoserTree(vector<unique_ptr<RunReader>>& runs, Order order)
+        : runs(runs), order(order), losers(runs.size()) {
+        size_t k = runs.size();
+        if (k == 0) {
+            return;
+        }
+        // Play the full tournament once. Leaves k..2k-1 are the runs and
+        // internal node n has children 2n and 2n+1.
+        vector<size_t> winners(2 * k); // Winner of each subtree
+        for (size_t i = 0; i < k; i++) {
+            winners[k + i] = i;
+        }
+        for (size_t n = k - 1; n >= 1; n--) {
+            size_t a = winners[2 * n];
+            size_t b = winners[2 * n + 1];
+            winners[n] = beats(a, b) ? a : b;
+            losers[n] = beats(a, b) ? b : a;
+        }
+        losers[0] = (k == 1) ? 0 : winners[1];
+    }
+
+    // Run holding the next bid, or a finished run once all are done
+    size_t winner() const { return losers[0]; }
+
+    // Restore the tree after the winning run has advanced
+    void replay() {
+        size_t k = runs.size();
+        size_t current = losers[0]; // Contender climbing the tree
+        for (size_t n = (current + k) / 2; n >= 1; n /= 2) {
+            if (beats(losers[n], current)) {
+                swap(losers[n], current); // The old loser goes on up
+            }
+        }
+        losers[0] = current;
+    }
+
+private:
+    // Whether run a's bid goes before run b's; finished runs lose
+    bool beats(size_t a, size_t b) const {
+        if (runs[a]->done() || runs[b]->done()) {
+            return !runs[a]->done();
+        }
+        int sign = order.compare(runs[a]->bid(), runs[b]->bid());
+        return sign < 0 || (sign == 0 && a < b);
+    }
+
+    vector<unique_ptr<RunReader>>& runs; // The runs being merged
+    Order order; // Order the runs are sorted in
+    vector<size_t> losers; // losers[0] is the winner, losers[n] the loser at node n
+};
+
+// Sorts batch mode can run and the keys each one sorts on. The comparison
+// sorts take every key; index and radix only the keys they were built for.
+struct BatchSort {
+    const char* engine; // Name given to --sort
+    bool parallel; // Whether it runs on the thread pool and takes --threads
+    const char* keys[5]; // Names given to --key, unused slots null
+};
+
+static const BatchSort BATCH_SORTS[] = {
+    { "selection", false, { "title", "id", "amount", "amount-desc", "fund" } },
+    { "quick", false, { "title", "id", "amount", "amount-desc", "fund" } },
+    { "quick3", false, { "title", "id", "amount", "amount-desc", "fund" } },
+    { "merge", false, { "title", "id", "amount", "amount-desc", "fund" } },
+    { "parallel", true, { "title", "id", "amount", "amount-desc", "fund" } },
+    { "parallel-merge", true, { "title", "id", "amount", "amount-desc", "fund" } },
+    { "index", false, { "title" } },
+    { "radix", false, { "title", "id", "amount" } },
+    { "radix-numeric", false, { "id", "amount" } },
 };
 
 //============================================================================
@@ -36,137 +791,2380 @@ struct Bid {
 //============================================================================
 
 void displayBid(const Bid& bid);
-Bid getBid();
-vector<Bid> loadBids(const string& csvPath);
-int partition(vector<Bid>& bids, int begin, int end);
-void quickSort(vector<Bid>& bids, int begin, int end);
-void selectionSort(vector<Bid>& bids);
-double strToDouble(string str, char ch);
+void displayBids(const vector<Bid>& bids, ostream& out = cout);
+void exportBids(const vector<Bid>& bids, const string& path);
+const char* phaseName(int choice);
+void displayStats(ostream& out = cout);
+Bid getBid(BidStore& store);
+Bid* findBid(BidStore& store, string_view bidId);
+bool deleteBid(BidStore& store, string_view bidId);
+bool upsertBid(BidStore& store, const Bid& bid);
+vector<uint32_t> findBidsInRange(BidStore& store, double minAmount, double maxAmount,
+                                 uint32_t fromDate, uint32_t toDate);
+BidStore loadBids(const string& csvPath);
+size_t appendBids(const string& csvPath, BidStore& store);
+size_t appendSortedBids(const string& csvPath, BidStore& store);
+csv::Projection bidColumns();
+void saveSnapshot(const BidStore& store, const string& path);
+size_t loadBidTable(const string& csvPath, BidTable& table);
+void buildBidTable(const vector<Bid>& bids, BidTable& table);
+size_t joinBidDetails(const string& csvPath, BidTable& table);
+string formatMoney(double amount);
+AmountTotals totalAmounts(const BidTable& table, uint32_t fundId);
+vector<AmountTotals> totalsByFund(const BidTable& table);
+vector<GroupTotals> groupTotals(const BidTable& table, const vector<uint32_t>& keys,
+                                size_t groups, ThreadPool& pool);
+BidStore loadSnapshot(const string& path);
+bool addBid(const csv::RowView& row, BidStore& store);
+template <typename Order = TitleOrder>
+size_t externalSort(const string& csvPath, const string& outPath,
+                    const ExternalSortOptions& options = ExternalSortOptions(), Order order = Order());
+template <typename Order>
+void mergeRuns(const vector<string>& paths, Order order, StringPool& funds,
+               const function<void(const Bid&)>& sink);
+void writeRunRecord(ostream& out, const Bid& bid);
+void writeCsvHeader(ostream& out);
+void writeCsvRecord(ostream& out, const Bid& bid);
+template <typename Order = TitleOrder>
+int medianOfThree(const vector<Bid>& bids, int a, int b, int c, Order order = Order());
+template <typename Order = TitleOrder>
+int choosePivot(const vector<Bid>& bids, int begin, int end, Order order = Order());
+template <typename Order = TitleOrder>
+int partition(vector<Bid>& bids, int begin, int end, Order order = Order());
+template <typename Order = TitleOrder>
+void quickSort(vector<Bid>& bids, int begin, int end, Order order = Order());
+int introDepthLimit(int size);
+template <typename Order = TitleOrder>
+void introSort(vector<Bid>& bids, int begin, int end, int depthLimit, Order order = Order());
+template <typename Order = TitleOrder>
+void insertionSort(vector<Bid>& bids, int begin, int end, Order order = Order());
+template <typename Order = TitleOrder>
+void heapSort(vector<Bid>& bids, int begin, int end, Order order = Order());
+template <typename Order = TitleOrder>
+void quickSort3Way(vector<Bid>& bids, int begin, int end, Order order = Order());
+template <typename Order = TitleOrder>
+void threeWaySort(vector<Bid>& bids, int begin, int end, int depthLimit, Order order = Order());
+template <typename Order = TitleOrder>
+void mergeSort(vector<Bid>& bids, Order order = Order());
+vector<uint32_t> sortedIndex(const vector<Bid>& bids);
+void applyPermutation(vector<Bid>& bids, const vector<uint32_t>& order);
+void radixSort(vector<Bid>& bids, string_view Bid::* key);
+void americanFlagSort(vector<Bid>& bids, size_t begin, size_t end, size_t depth, string_view Bid::* key);
+uint64_t auctionIdKey(string_view bidId);
+void radixSortByAmount(vector<Bid>& bids);
+void radixSortByAuctionId(vector<Bid>& bids);
+template <typename Order = TitleOrder>
+void parallelQuickSort(vector<Bid>& bids, ThreadPool& pool, Order order = Order());
+template <typename Order = TitleOrder>
+void parallelMergeSort(vector<Bid>& bids, ThreadPool& pool, Order order = Order());
+template <typename Order>
+void mergeSortRange(vector<Bid>& bids, vector<Bid>& scratch, size_t begin, size_t end,
+                    bool intoScratch, ThreadPool& pool, Order order);
+template <typename Order>
+void parallelMerge(const vector<Bid>& src, size_t lo1, size_t hi1, size_t lo2, size_t hi2,
+                   vector<Bid>& dst, size_t out, ThreadPool& pool, Order order);
+template <typename Order = TitleOrder>
+void selectionSort(vector<Bid>& bids, Order order = Order());
+template <typename Order = TitleOrder>
+vector<Bid> topBids(const vector<Bid>& bids, size_t k, Order order = Order());
+template <typename Order = TitleOrder>
+bool isSorted(const vector<Bid>& bids, Order order = Order());
+template <typename Order = TitleOrder>
+void mergeAppended(vector<Bid>& bids, size_t mid, Order order = Order());
+bool parseMoney(string_view field, double& value);
+template <typename Order>
+bool sortWith(vector<Bid>& bids, const string& engine, ThreadPool* pool, Order order);
+bool sortBids(vector<Bid>& bids, const string& engine, const string& key, ThreadPool* pool);
+bool canSort(const string& engine, const string& key);
+bool isParallelSort(const string& engine);
+bool topBidsBy(const vector<Bid>& bids, size_t k, const string& key, vector<Bid>& top);
+int runBatch(int argc, char* argv[]);
 
 //============================================================================
 // Function Implementations
 //============================================================================
 
 /**
- * Display the bid information to the console.
+ * Display the bid information to the console.
+ *
+ * @param bid struct containing the bid info
+ */
+void displayBid(const Bid& bid) {
+    cout << bid.bidId << ": " << bid.title << " | " << bid.amount << " | "
+         << bid.fund << endl;
+}
+
+/**
+ * Display many bids in displayBid's format through one BidWriter.
+ *
+ * @param bids The bids to display, in order
+ * @param out Where to write them, the console by default
+ */
+void displayBids(const vector<Bid>& bids, ostream& out) {
+    BidWriter writer(out); // Flushed once the last bid is formatted
+    for (const Bid& bid : bids) {
+        writer.write(bid);
+    }
+}
+
+/**
+ * Write the bids in displayBid's format to a file, or to the console
+ * when the path is "-". A named pipe works like any other file.
+ *
+ * @param bids The bids to export, in order
+ * @param path The file to write
+ */
+void exportBids(const vector<Bid>& bids, const string& path) {
+    if (path == "-") {
+        displayBids(bids);
+        return;
+    }
+    ofstream out(path, ios::binary); // The export file
+    if (!out) {
+        throw runtime_error("cannot create " + path);
+    }
+    displayBids(bids, out);
+    if (!out) {
+        throw runtime_error("cannot write " + path);
+    }
+}
+
+/**
+ * Prompt user for bid information using console (std::in)
+ *
+ * @param store the store that will hold the bid's strings
+ * @return Bid struct containing the bid info
+ */
+Bid getBid(BidStore& store) {
+    Bid bid; // Create a new Bid instance
+    string text; // Line read from the console
+
+    cout << "Enter Id: ";
+    cin >> ws;
+    getline(cin, text);
+    bid.bidId = store.strings.store(text);
+
+    cout << "Enter title: ";
+    getline(cin, text);
+    bid.title = store.strings.store(text);
+    bid.titleKey = titlePrefix(bid.title);
+
+    cout << "Enter fund: ";
+    getline(cin, text);
+    bid.fundId = store.funds.intern(text);
+    bid.fund = store.funds.name(bid.fundId);
+
+    cout << "Enter amount: ";
+    getline(cin, text);
+    if (!parseMoney(text, bid.amount)) {
+        cerr << "Malformed amount (read as 0)" << endl;
+    }
+
+    cout << "Enter close date (m/d/yyyy): ";
+    getline(cin, text);
+    if (!parseDate(text, bid.closeDate)) {
+        cerr << "Malformed close date (left blank)" << endl;
+    }
+    return bid;
+}
+
+/**
+ * Find a bid by auction ID through the store's hash index, building the
+ * index first if the bids have moved since the last lookup.
+ *
+ * @param store the store to search
+ * @param bidId the auction ID to find
+ * @return the bid, or nullptr if there is none
+ */
+Bid* findBid(BidStore& store, string_view bidId) {
+    if (store.byId.empty() && !store.bids.empty()) {
+        store.byId.build(store.bids);
+    }
+    size_t position = store.byId.find(store.bids, bidId);
+    return position == BidIndex::NOT_FOUND ? nullptr : &store.bids[position];
+}
+
+/**
+ * Delete a bid by auction ID. The last bid moves into the hole, so this
+ * takes constant time but gives up any sort order.
+ *
+ * @param store the store to delete from
+ * @param bidId the auction ID to delete
+ * @return false if there was no such bid
+ */
+bool deleteBid(BidStore& store, string_view bidId) {
+    Bid* bid = findBid(store, bidId);
+    if (bid == nullptr) {
+        return false;
+    }
+    vector<Bid>& bids = store.bids; // The bids themselves
+    size_t position = bid - bids.data(); // Hole to fill
+    store.byId.erase(bids, bidId);
+    if (position != bids.size() - 1) {
+        bids[position] = bids.back();
+        store.byId.moved(bids, position);
+        store.sortedByTitle = false;
+    }
+    bids.pop_back();
+    store.byAmount.clear(); // Positions changed under the range indexes
+    store.byCloseDate.clear();
+    return true;
+}
+
+/**
+ * Insert a bid, or replace the bid with the same auction ID in place.
+ *
+ * @param store the store to update; bid's strings must live in it
+ * @param bid the new bid
+ * @return true if the bid was inserted, false if it replaced another
+ */
+bool upsertBid(BidStore& store, const Bid& bid) {
+    Bid* existing = findBid(store, bid.bidId);
+    if (existing != nullptr) {
+        *existing = bid;
+    } else {
+        store.bids.push_back(bid);
+        store.byId.insert(store.bids, store.bids.size() - 1);
+    }
+    if (store.bids.size() > 1) {
+        store.sortedByTitle = false; // The title may now be out of place
+    }
+    store.byAmount.clear(); // The keys may have changed
+    store.byCloseDate.clear();
+    return existing == nullptr;
+}
+
+/**
+ * Find the bids whose amount and close date both fall in the given
+ * inclusive ranges. Both sorted indexes are built on first use. Each
+ * range is located with two binary searches; the narrower one is then
+ * walked and its bids checked against the other range, so the cost is
+ * logarithmic plus the size of the narrower range.
+ *
+ * @param store the store to search
+ * @param minAmount the smallest amount wanted
+ * @param maxAmount the largest amount wanted
+ * @param fromDate the first close date wanted, as yyyymmdd
+ * @param toDate the last close date wanted, as yyyymmdd
+ * @return positions of the matching bids, in amount or close date order
+ */
+vector<uint32_t> findBidsInRange(BidStore& store, double minAmount, double maxAmount,
+                                 uint32_t fromDate, uint32_t toDate) {
+    const vector<Bid>& bids = store.bids; // The bids themselves
+    if (store.byAmount.empty() && !bids.empty()) {
+        store.byAmount.build(bids, [](const Bid& bid) { return amountKey(bid.amount); });
+        store.byCloseDate.build(bids, [](const Bid& bid) { return uint64_t(bid.closeDate); });
+    }
+
+    pair<size_t, size_t> amounts = store.byAmount.range(amountKey(minAmount), amountKey(maxAmount));
+    pair<size_t, size_t> dates = store.byCloseDate.range(fromDate, toDate);
+    bool byAmount = amounts.second - amounts.first <= dates.second - dates.first; // Walk the narrower range
+    const RangeIndex& index = byAmount ? store.byAmount : store.byCloseDate;
+    pair<size_t, size_t> walk = byAmount ? amounts : dates;
+
+    vector<uint32_t> found; // Positions of the matches
+    for (size_t i = walk.first; i < walk.second; i++) {
+        const Bid& bid = bids[index.positions[i]];
+        if (bid.amount >= minAmount && bid.amount <= maxAmount
+            && bid.closeDate >= fromDate && bid.closeDate <= toDate) {
+            found.push_back(index.positions[i]);
+        }
+    }
+    return found;
+}
+
+/**
+ * Name under which a menu choice's counters are recorded.
+ *
+ * @param choice The menu choice
+ * @return the phase name
+ */
+const char* phaseName(int choice) {
+    switch (choice) {
+    case 1: case 17: case 20: return "load";
+    case 2: case 16: case 21: return "display";
+    case 3: return "selection sort";
+    case 4: return "quick sort";
+    case 5: return "three-way quick sort";
+    case 6: return "index sort";
+    case 7: case 8: case 10: case 11: return "radix sort";
+    case 12: case 13: return "parallel sort";
+    case 15: return "multi-key sort";
+    case 18: return "external sort";
+    case 22: case 23: case 24: case 25: return "lookup";
+    case 26: case 27: return "aggregate";
+    default: return "other";
+    }
+}
+
+/**
+ * Display the counters of each phase and the totals, then reset them.
+ *
+ * @param out Where to write them, the console by default
+ */
+void displayStats(ostream& out) {
+    if (!stats::enabled()) {
+        out << "Statistics are off; rebuild with -DVECTORSORTING_STATS" << endl;
+        return;
+    }
+    auto display = [&out](const string& name, uint64_t runs, const stats::Totals& totals) {
+        out << name;
+        if (runs != 0) {
+            out << " (" << runs << (runs == 1 ? " run)" : " runs)");
+        }
+        out << endl;
+        for (size_t i = 0; i < stats::COUNTER_COUNT; i++) {
+            if (totals.values[i] != 0) {
+                out << "    " << stats::COUNTER_NAMES[i] << ": " << totals.values[i] << endl;
+            }
+        }
+    };
+    for (const stats::PhaseTotals& phase : stats::phases()) {
+        display(phase.name, phase.runs, phase.totals);
+    }
+    display("total", 0, stats::current());
+    stats::reset();
+}
+
+/**
+ * Load a CSV file containing bids into a store.
+ *
+ * @param csvPath the path to the CSV file to load
+ * @return a store holding all the bids read from the CSV
+ */
+BidStore loadBids(const string& csvPath) {
+    BidStore store; // Store to hold loaded bids and their strings
+    appendBids(csvPath, store);
+    store.sortedByTitle = isSorted(store.bids); // One linear check spares a later sort
+    return store;
+}
+
+/**
+ * Load a CSV file of bids and add them after the bids already in a store.
+ *
+ * @param csvPath the path to the CSV file to load
+ * @param store the store to add the bids to
+ * @return the number of bids added
+ */
+size_t appendBids(const string& csvPath, BidStore& store) {
+    cout << "Loading CSV file " << csvPath << endl;
+
+    size_t before = store.bids.size(); // Bids already in the store
+    StringArena::Mark mark = store.strings.mark(); // Where their strings end
+    size_t malformed = 0; // Rows whose winning bid could not be parsed
+
+    try {
+        // Convert each row as it is parsed; only the bids are kept
+        auto convert = [&store, &malformed](const csv::RowView& row) {
+            if (!addBid(row, store)) {
+                malformed++;
+            }
+        };
+        if (thread::hardware_concurrency() > 1) {
+            // Reads, parsing and conversion overlap; memory stays a few chunks
+            csv::PipelinedReader file(csvPath, ',', bidColumns());
+            file.forEachRow(convert);
+        } else {
+            // One core gains nothing from the hand-offs
+            csv::Reader file(csvPath, ',', 1 << 20, bidColumns()); // Stream the file one chunk at a time
+            file.forEachRow(convert);
+        }
+    } catch (csv::Error &e) {
+        // All or nothing: drop the bids read before the bad record
+        cerr << "Error loading CSV: " << e.what() << endl; // Handle CSV errors
+        cerr << "No bids loaded from " << csvPath << "; " << store.bids.size() - before
+             << " read before the error were dropped" << endl;
+        store.bids.resize(before);
+        store.strings.rewind(mark);
+        return 0;
+    }
+    if (malformed != 0) {
+        cerr << malformed << " bids had a malformed winning bid (read as 0)" << endl;
+    }
+    if (store.bids.size() != before) {
+        store.sortedByTitle = false; // New bids went on the end
+    }
+    return store.bids.size() - before;
+}
+
+/**
+ * The columns a Bid is built from: title, auction ID, close date,
+ * winning bid and fund. Every other column is skipped by the parser.
+ *
+ * @return the projection to hand to the CSV readers
+ */
+csv::Projection bidColumns() {
+    return csv::Projection().column(0).column(1).column(3).column(4).column(8);
+}
+
+/**
+ * Convert one parsed row into a Bid at the end of a store.
+ *
+ * @param row the row, read with bidColumns()
+ * @param store the store receiving the bid and its strings
+ * @return false if the winning bid was malformed and read as 0
+ */
+bool addBid(const csv::RowView& row, BidStore& store) {
+    Bid bid; // Create a new Bid instance
+    bid.bidId = store.strings.store(row[1]); // Read bid ID
+    bid.title = store.strings.store(row[0]);  // Read title
+    bid.titleKey = titlePrefix(bid.title); // Cache the sort prefix
+    bid.fundId = store.funds.intern(row[8]);   // Read fund
+    bid.fund = store.funds.name(bid.fundId);
+    parseDate(row[3], bid.closeDate); // Read close date; a bad one is left blank
+    bool valid = parseMoney(row[4], bid.amount); // Parse amount straight from the field
+
+    store.bids.push_back(bid); // Add the bid to the vector
+    return valid;
+}
+
+/**
+ * Load a CSV file of bids into a store that is already in title order and
+ * keep it in order: only the new batch is sorted, then it is merged into
+ * the existing bids in one linear pass.
+ *
+ * @param csvPath the path to the CSV file to load
+ * @param store the store to add the bids to; sorted first if it isn't
+ * @return the number of bids added
+ */
+size_t appendSortedBids(const string& csvPath, BidStore& store) {
+    vector<Bid>& bids = store.bids; // The bids themselves
+    if (!store.sortedByTitle) {
+        quickSort(bids, 0, bids.size() - 1); // Bring the history into order once
+    }
+
+    size_t mid = bids.size(); // Where the new batch starts
+    size_t added = appendBids(csvPath, store);
+    quickSort(bids, mid, bids.size() - 1); // Sort just the new batch
+    mergeAppended(bids, mid);
+    store.sortedByTitle = true;
+    return added;
+}
+
+/**
+ * Pick the index of the median title among three positions.
+ *
+ * @param bids Reference to the vector<Bid> holding the candidates
+ * @param a First candidate index
+ * @param b Second candidate index
+ * @param c Third candidate index
+ * @param order The sort order
+ * @return Whichever of a, b and c holds the median title
+ */
+template <typename Order>
+int medianOfThree(const vector<Bid>& bids, int a, int b, int c, Order order) {
+    if (order(bids[a], bids[b])) {
+        if (order(bids[b], bids[c])) return b; // a < b < c
+        return order(bids[a], bids[c]) ? c : a; // a < c <= b or c <= a < b
+    }
+    if (order(bids[a], bids[c])) return a; // b <= a < c
+    return order(bids[b], bids[c]) ? c : b; // b < c <= a or c <= b <= a
+}
+
+/**
+ * Pick a quick sort pivot: the median of three, or for large ranges the
+ * median of three medians, so sorted, reversed and organ-pipe inputs
+ * still split evenly.
+ *
+ * @param bids Reference to the vector<Bid> holding the range
+ * @param begin Starting index of the range
+ * @param end Ending index of the range
+ * @param order The sort order
+ * @return Index of the chosen pivot
+ */
+template <typename Order>
+int choosePivot(const vector<Bid>& bids, int begin, int end, Order order) {
+    int mid = begin + (end - begin) / 2; // Middle of the range
+    if (end - begin >= 128) {
+        // Ninther: median of the medians of three evenly spaced triples
+        int step = (end - begin) / 8;
+        return medianOfThree(bids,
+                             medianOfThree(bids, begin, begin + step, begin + 2 * step, order),
+                             medianOfThree(bids, mid - step, mid, mid + step, order),
+                             medianOfThree(bids, end - 2 * step, end - step, end, order),
+                             order);
+    }
+    return medianOfThree(bids, begin, mid, end, order);
+}
+
+/**
+ * Partition the vector of bids into two parts for quick sort, around the
+ * pivot from choosePivot.
+ *
+ * @param bids Reference to the vector<Bid> to be partitioned
+ * @param begin Starting index for the partition
+ * @param end Ending index for the partition
+ * @param order The sort order
+ * @return Index of the pivot after partitioning
+ */
+template <typename Order>
+int partition(vector<Bid>& bids, int begin, int end, Order order) {
+    int mid = begin + (end - begin) / 2; // Middle of the range
+    swap(bids[choosePivot(bids, begin, end, order)], bids[mid]); // Move the pivot to the middle
+    STATS_ADD(SWAPS, 1);
+
+    Bid pivot = bids[mid]; // Copy of the pivot; swaps below may move the original
+    int low = begin; // Initialize low index
+    int high = end;  // Initialize high index
+
+    while (true) {
+        // Increment low index while the bid title is less than the pivot
+        while (order(bids[low], pivot)) low++;
+        // Decrement high index while the bid title is greater than the pivot
+        while (order(pivot, bids[high])) high--;
+
+        if (low >= high) return high; // If indices cross, return high index
+
+        // Swap the elements at low and high indices
+        swap(bids[low], bids[high]);
+        STATS_ADD(SWAPS, 1);
+        low++; // Move low index up
+        high--; // Move high index down
+    }
+}
+
+/**
+ * Perform quick sort on the vector of bids by title, or by another order.
+ *
+ * This is an introsort: quick sort with small ranges finished by
+ * insertion sort and a heap sort fallback once the recursion gets too
+ * deep, so the worst case is O(n log n) time and O(log n) stack.
+ *
+ * @param bids Reference to the vector<Bid> to be sorted
+ * @param begin Starting index for the sort
+ * @param end Ending index for the sort
+ * @param order The sort order, TitleOrder by default
+ */
+template <typename Order>
+void quickSort(vector<Bid>& bids, int begin, int end, Order order) {
+    if (begin < end) {
+        introSort(bids, begin, end, introDepthLimit(end - begin + 1), order);
+    }
+}
+
+/**
+ * Partitioning levels introsort allows before falling back to heap sort.
+ *
+ * @param size Number of bids being sorted
+ * @return 2 * floor(log2(size))
+ */
+int introDepthLimit(int size) {
+    int depthLimit = 0;
+    for (int n = size; n > 1; n >>= 1) {
+        depthLimit += 2;
+    }
+    return depthLimit;
+}
+
+/**
+ * Introsort worker for quickSort. Recurses only into the smaller side of
+ * each partition and loops on the larger one.
+ *
+ * @param bids Reference to the vector<Bid> to be sorted
+ * @param begin Starting index for the sort
+ * @param end Ending index for the sort
+ * @param depthLimit Partitioning levels left before falling back to heap sort
+ * @param order The sort order
+ */
+template <typename Order>
+void introSort(vector<Bid>& bids, int begin, int end, int depthLimit, Order order) {
+    const int INSERTION_SORT_CUTOFF = 16; // Ranges this small are sorted directly
+    STATS_DEPTH();
+
+    while (end - begin + 1 > INSERTION_SORT_CUTOFF) {
+        if (depthLimit-- == 0) {
+            heapSort(bids, begin, end, order); // Too many bad pivots; cap the cost
+            return;
+        }
+        int mid = partition(bids, begin, end, order); // Partition the bids
+        if (mid - begin < end - mid) {
+            introSort(bids, begin, mid, depthLimit, order); // Recursively sort the smaller left side
+            begin = mid + 1; // Continue with the right side
+        } else {
+            introSort(bids, mid + 1, end, depthLimit, order); // Recursively sort the smaller right side
+            end = mid; // Continue with the left side
+        }
+    }
+    insertionSort(bids, begin, end, order);
+}
+
+/**
+ * Perform insertion sort on a range of bids (stable).
+ *
+ * @param bids Reference to the vector<Bid> to be sorted
+ * @param begin Starting index for the sort
+ * @param end Ending index for the sort
+ * @param order The sort order
+ */
+template <typename Order>
+void insertionSort(vector<Bid>& bids, int begin, int end, Order order) {
+    for (int i = begin + 1; i <= end; i++) {
+        Bid bid = bids[i]; // Bid being inserted
+        int j = i - 1;
+        // Shift larger bids one place to the right
+        while (j >= begin && order(bid, bids[j])) {
+            bids[j + 1] = bids[j];
+            STATS_ADD(MOVES, 1);
+            j--;
+        }
+        bids[j + 1] = bid;
+        STATS_ADD(MOVES, 1);
+    }
+}
+
+/**
+ * Perform heap sort on a range of bids.
+ *
+ * @param bids Reference to the vector<Bid> to be sorted
+ * @param begin Starting index for the sort
+ * @param end Ending index for the sort
+ * @param order The sort order
+ */
+template <typename Order>
+void heapSort(vector<Bid>& bids, int begin, int end, Order order) {
+    int size = end - begin + 1; // Number of bids in the range
+
+    // Move the bid at root down until the max-heap property holds again
+    auto siftDown = [&bids, begin, order](int root, int size) {
+        while (true) {
+            int child = 2 * root + 1; // Left child
+            if (child >= size) return;
+            if (child + 1 < size && order(bids[begin + child], bids[begin + child + 1])) {
+                child++; // Right child is larger
+            }
+            if (!order(bids[begin + root], bids[begin + child])) return;
+            swap(bids[begin + root], bids[begin + child]);
+            root = child;
+        }
+    };
+
+    for (int root = size / 2 - 1; root >= 0; root--) {
+        siftDown(root, size); // Build the heap
+    }
+    for (int last = size - 1; last > 0; last--) {
+        swap(bids[begin], bids[begin + last]); // Move the largest to the end
+        siftDown(0, last);
+    }
+}
+
+/**
+ * Perform three-way (Dutch national flag) quick sort on the vector of bids
+ * by title, or by another order.
+ *
+ * Each pass splits the range into bids less than, equal to and greater
+ * than the pivot. The equal block is final and never visited again, so
+ * heavily repeated titles cost one pass instead of many. Pivots, the
+ * insertion sort cutoff and the heap sort fallback are shared with
+ * introsort, so the worst case is O(n log n) here too.
+ *
+ * @param bids Reference to the vector<Bid> to be sorted
+ * @param begin Starting index for the sort
+ * @param end Ending index for the sort
+ * @param order The sort order
+ */
+template <typename Order>
+void quickSort3Way(vector<Bid>& bids, int begin, int end, Order order) {
+    if (begin < end) {
+        threeWaySort(bids, begin, end, introDepthLimit(end - begin + 1), order);
+    }
+}
+
+/**
+ * Three-way quick sort worker for quickSort3Way. Recurses only into the
+ * smaller outer block and loops on the larger one.
+ *
+ * @param bids Reference to the vector<Bid> to be sorted
+ * @param begin Starting index for the sort
+ * @param end Ending index for the sort
+ * @param depthLimit Partitioning levels left before falling back to heap sort
+ * @param order The sort order
+ */
+template <typename Order>
+void threeWaySort(vector<Bid>& bids, int begin, int end, int depthLimit, Order order) {
+    const int INSERTION_SORT_CUTOFF = 16; // Ranges this small are sorted directly
+    STATS_DEPTH();
+
+    while (end - begin + 1 > INSERTION_SORT_CUTOFF) {
+        if (depthLimit-- == 0) {
+            heapSort(bids, begin, end, order); // Too many bad pivots; cap the cost
+            return;
+        }
+        swap(bids[choosePivot(bids, begin, end, order)], bids[begin]); // Pivot goes first
+        Bid pivot = bids[begin]; // Copy of the pivot; swaps below move the original
+
+        int lt = begin; // bids[begin..lt-1] are less than the pivot
+        int gt = end;   // bids[gt+1..end] are greater than the pivot
+        int i = begin + 1; // bids[lt..i-1] are equal to the pivot
+
+        while (i <= gt) {
+            int sign = order.compare(bids[i], pivot); // One comparison per bid
+            if (sign < 0) {
+                swap(bids[lt++], bids[i++]); // Grow the less-than block
+            } else if (sign > 0) {
+                swap(bids[i], bids[gt--]); // Grow the greater-than block
+            } else {
+                i++; // Equal to the pivot; leave it in the middle
+            }
+        }
+
+        // Recursively sort the smaller side and continue with the larger one
+        if (lt - begin < end - gt) {
+            threeWaySort(bids, begin, lt - 1, depthLimit, order);
+            begin = gt + 1;
+        } else {
+            threeWaySort(bids, gt + 1, end, depthLimit, order);
+            end = lt - 1;
+        }
+    }
+    insertionSort(bids, begin, end, order);
+}
+
+/**
+ * Perform a stable merge sort on the vector of bids, for multi-key orders
+ * where bids that compare equal must keep their current order.
+ *
+ * Runs of 32 bids are insertion sorted, then merged bottom up through a
+ * scratch buffer.
+ *
+ * @param bids Reference to the vector<Bid> to be sorted
+ * @param order The sort order
+ */
+template <typename Order>
+void mergeSort(vector<Bid>& bids, Order order) {
+    const size_t RUN = 32; // Length of the insertion sorted runs
+    size_t size = bids.size(); // Number of bids
+
+    for (size_t begin = 0; begin < size; begin += RUN) {
+        insertionSort(bids, static_cast<int>(begin), static_cast<int>(min(begin + RUN, size)) - 1, order);
+    }
+
+    vector<Bid> scratch(size); // Destination of each merge pass
+    for (size_t width = RUN; width < size; width *= 2) {
+        for (size_t lo = 0; lo < size; lo += 2 * width) {
+            size_t mid = min(lo + width, size); // End of the left run
+            size_t hi = min(lo + 2 * width, size); // End of the right run
+            size_t left = lo; // Next bid of the left run
+            size_t right = mid; // Next bid of the right run
+            size_t out = lo; // Next slot in scratch
+
+            // Take from the left run unless the right one is strictly smaller
+            while (left < mid && right < hi) {
+                scratch[out++] = order(bids[right], bids[left]) ? bids[right++] : bids[left++];
+            }
+            while (left < mid) scratch[out++] = bids[left++];
+            while (right < hi) scratch[out++] = bids[right++];
+        }
+        bids.swap(scratch);
+    }
+}
+
+/**
+ * Sort a permutation of the bids by title, leaving the bids where they are.
+ *
+ * The sort runs over compact (title prefix, position) pairs, so it only
+ * reads a bid when two prefixes tie. Use a BidView to read the result or
+ * applyPermutation to reorder the bids once.
+ *
+ * @param bids The bids to order
+ * @return Positions of the bids in title order
+ */
+vector<uint32_t> sortedIndex(const vector<Bid>& bids) {
+    struct KeyedIndex {
+        uint64_t key; // Cached title prefix
+        uint32_t pos; // Position of the bid
+    };
+
+    vector<KeyedIndex> keyed(bids.size()); // Start from the identity permutation
+    for (size_t i = 0; i < keyed.size(); i++) {
+        keyed[i].key = bids[i].titleKey;
+        keyed[i].pos = static_cast<uint32_t>(i);
+    }
+    sort(keyed.begin(), keyed.end(), [&bids](const KeyedIndex& a, const KeyedIndex& b) {
+        if (a.key != b.key) {
+            return a.key < b.key;
+        }
+        return bids[a.pos].title < bids[b.pos].title;
+    });
+
+    vector<uint32_t> order(keyed.size()); // Strip the keys
+    for (size_t i = 0; i < keyed.size(); i++) {
+        order[i] = keyed[i].pos;
+    }
+    return order;
+}
+
+/**
+ * Reorder the bids so that bids[i] becomes the bid at position order[i].
+ * Each bid is moved exactly once.
+ *
+ * @param bids Reference to the vector<Bid> to reorder
+ * @param order A permutation of the positions in bids
+ */
+void applyPermutation(vector<Bid>& bids, const vector<uint32_t>& order) {
+    vector<Bid> sorted; // Bids in their new order
+    sorted.reserve(order.size());
+    for (size_t i = 0; i < order.size(); i++) {
+        sorted.push_back(bids[order[i]]);
+    }
+    bids.swap(sorted);
+}
+
+/**
+ * Perform MSD radix sort on the vector of bids by a string field.
+ *
+ * Bids are distributed by one key byte at a time (American flag sort),
+ * which touches each byte of the keys a constant number of times instead
+ * of comparing whole strings O(n log n) times.
+ *
+ * @param bids Reference to the vector<Bid> to be sorted
+ * @param key The field to sort by, e.g. &Bid::title or &Bid::bidId
+ */
+void radixSort(vector<Bid>& bids, string_view Bid::* key) {
+    americanFlagSort(bids, 0, bids.size(), 0, key);
+}
+
+/**
+ * American flag sort worker for radixSort. Sorts bids[begin..end) whose
+ * keys already agree on their first depth bytes. Each level keeps a few
+ * KB of bucket arrays on the stack, so past DEPTH_CUTOFF shared bytes the
+ * rest of the keys are compared by introsort instead.
+ *
+ * @param bids Reference to the vector<Bid> to be sorted
+ * @param begin Starting index for the sort
+ * @param end One past the last index for the sort
+ * @param depth Byte position the keys are distributed on
+ * @param key The field to sort by
+ */
+void americanFlagSort(vector<Bid>& bids, size_t begin, size_t end, size_t depth, string_view Bid::* key) {
+    const size_t COMPARISON_CUTOFF = 32; // Buckets this small are insertion sorted
+    const size_t DEPTH_CUTOFF = 64; // Shared bytes after which buckets are comparison sorted
+    const int BUCKETS = 257; // Bucket 0 for keys that end here, then one per byte value
+
+    // Bucket of a bid at the current depth
+    auto bucketOf = [key, depth](const Bid& bid) {
+        string_view text = bid.*key;
+        return (depth < text.size()) ? static_cast<unsigned char>(text[depth]) + 1 : 0;
+    };
+
+    if (end - begin <= COMPARISON_CUTOFF) {
+        // Insertion sort on the rest of the keys; the first depth bytes are equal
+        for (size_t i = begin + 1; i < end; i++) {
+            Bid bid = bids[i]; // Bid being inserted
+            string_view rest = (bid.*key).substr(min(depth, (bid.*key).size()));
+            size_t j = i;
+            while (j > begin) {
+                string_view other = bids[j - 1].*key;
+                if (!(rest < other.substr(min(depth, other.size())))) break;
+                bids[j] = bids[j - 1]; // Shift larger keys one place to the right
+                j--;
+            }
+            bids[j] = bid;
+        }
+        return;
+    }
+    if (depth >= DEPTH_CUTOFF) {
+        // Long shared prefix: bound the recursion and compare what is left
+        int last = static_cast<int>(end) - 1; // introSort takes inclusive bounds
+        introSort(bids, static_cast<int>(begin), last, introDepthLimit(last - static_cast<int>(begin) + 1),
+                  SuffixOrder(key, depth));
+        return;
+    }
+
+    // Count the bids in each bucket
+    size_t counts[BUCKETS] = {};
+    for (size_t i = begin; i < end; i++) {
+        counts[bucketOf(bids[i])]++;
+    }
+
+    // Turn the counts into bucket boundaries
+    size_t starts[BUCKETS]; // Where each bucket begins
+    size_t next[BUCKETS]; // Next unfilled slot in each bucket
+    size_t offset = begin;
+    for (int b = 0; b < BUCKETS; b++) {
+        starts[b] = offset;
+        next[b] = offset;
+        offset += counts[b];
+    }
+
+    // Permute in place: swap each bid straight into its bucket
+    for (int b = 0; b < BUCKETS; b++) {
+        size_t limit = starts[b] + counts[b]; // End of bucket b
+        while (next[b] < limit) {
+            int target = bucketOf(bids[next[b]]);
+            if (target == b) {
+                next[b]++; // Already in place
+            } else {
+                swap(bids[next[b]], bids[next[target]++]);
+            }
+        }
+    }
+
+    // Keys in bucket 0 ended at this depth and are all equal; recurse on the rest
+    for (int b = 1; b < BUCKETS; b++) {
+        if (counts[b] > 1) {
+            americanFlagSort(bids, starts[b], starts[b] + counts[b], depth + 1, key);
+        }
+    }
+}
+
+/**
+ * Map an amount to an unsigned integer with the same order, so amounts can
+ * be radix sorted: positive values get the sign bit set, negative values
+ * have all bits flipped.
+ *
+ * @param amount The amount to encode
+ * @return The order-preserving encoding
+ */
+uint64_t amountKey(double amount) {
+    uint64_t bits; // Raw IEEE 754 bits
+    memcpy(&bits, &amount, sizeof(bits));
+    const uint64_t SIGN = uint64_t(1) << 63;
+    return (bits & SIGN) ? ~bits : (bits | SIGN);
+}
+
+/**
+ * Map an auction ID to its numeric value for sorting. IDs that are not
+ * plain numbers sort after all numeric ones.
+ *
+ * @param bidId The auction ID text
+ * @return The numeric ID, or the largest key if it is not a number
+ */
+uint64_t auctionIdKey(string_view bidId) {
+    uint64_t id = 0; // Parsed ID
+    from_chars_result result = from_chars(bidId.data(), bidId.data() + bidId.size(), id);
+    if (bidId.empty() || result.ec != errc() || result.ptr != bidId.data() + bidId.size()) {
+        return UINT64_MAX;
+    }
+    return id;
+}
+
+/**
+ * Stable LSD radix sort of 64-bit keys, one byte per pass. Passes where
+ * every key has the same byte are skipped, so small keys cost fewer passes.
+ *
+ * @param keys One key per bid
+ * @return Positions of the keys in ascending key order
+ */
+vector<uint32_t> lsdRadixOrder(const vector<uint64_t>& keys) {
+    size_t size = keys.size(); // Number of keys
+    vector<uint32_t> order(size); // Current order of the positions
+    vector<uint32_t> scratch(size); // Destination of each pass
+    for (size_t i = 0; i < size; i++) {
+        order[i] = static_cast<uint32_t>(i);
+    }
+
+    for (int shift = 0; shift < 64; shift += 8) {
+        size_t counts[256] = {}; // Keys per byte value in this pass
+        for (size_t i = 0; i < size; i++) {
+            counts[(keys[i] >> shift) & 0xFF]++;
+        }
+        if (size == 0 || counts[(keys[0] >> shift) & 0xFF] == size) {
+            continue; // Every key shares this byte
+        }
+
+        size_t offset = 0; // Turn the counts into starting positions
+        for (int b = 0; b < 256; b++) {
+            size_t count = counts[b];
+            counts[b] = offset;
+            offset += count;
+        }
+        for (size_t i = 0; i < size; i++) {
+            uint32_t pos = order[i];
+            scratch[counts[(keys[pos] >> shift) & 0xFF]++] = pos;
+        }
+        order.swap(scratch);
+    }
+    return order;
+}
+
+/**
+ * Perform LSD radix sort on the vector of bids by amount (stable).
+ *
+ * @param bids Reference to the vector<Bid> to be sorted
+ */
+void radixSortByAmount(vector<Bid>& bids) {
+    vector<uint64_t> keys(bids.size()); // Encoded amounts
+    for (size_t i = 0; i < bids.size(); i++) {
+        keys[i] = amountKey(bids[i].amount);
+    }
+    applyPermutation(bids, lsdRadixOrder(keys));
+}
+
+/**
+ * Perform LSD radix sort on the vector of bids by numeric auction ID (stable).
+ *
+ * @param bids Reference to the vector<Bid> to be sorted
+ */
+void radixSortByAuctionId(vector<Bid>& bids) {
+    vector<uint64_t> keys(bids.size()); // Numeric auction IDs
+    for (size_t i = 0; i < bids.size(); i++) {
+        keys[i] = auctionIdKey(bids[i].bidId);
+    }
+    applyPermutation(bids, lsdRadixOrder(keys));
+}
+
+/**
+ * Perform quick sort on the vector of bids by title (or by another order)
+ * using a thread pool.
+ *
+ * While a range is large, it is partitioned and its smaller side becomes a
+ * new task that idle workers can steal; small ranges finish with introSort.
+ *
+ * @param bids Reference to the vector<Bid> to be sorted
+ * @param pool The pool to run on
+ * @param order The sort order, TitleOrder by default
+ */
+template <typename Order>
+void parallelQuickSort(vector<Bid>& bids, ThreadPool& pool, Order order) {
+    const int PARALLEL_CUTOFF = 16 * 1024; // Smaller ranges aren't worth a task
+    if (bids.size() < 2) {
+        return;
+    }
+
+    TaskGroup group(pool); // Every range task joins this group
+    function<void(int, int, int)> sortRange = [&](int begin, int end, int depthLimit) {
+        while (end - begin + 1 > PARALLEL_CUTOFF) {
+            if (depthLimit-- == 0) {
+                heapSort(bids, begin, end, order); // Too many bad pivots; cap the cost
+                return;
+            }
+            int mid = partition(bids, begin, end, order); // Partition the bids
+            if (mid - begin < end - mid) {
+                group.run([&sortRange, begin, mid, depthLimit] { sortRange(begin, mid, depthLimit); });
+                begin = mid + 1; // Continue with the right side
+            } else {
+                group.run([&sortRange, mid, end, depthLimit] { sortRange(mid + 1, end, depthLimit); });
+                end = mid; // Continue with the left side
+            }
+        }
+        introSort(bids, begin, end, depthLimit, order);
+    };
+
+    int size = static_cast<int>(bids.size());
+    sortRange(0, size - 1, introDepthLimit(size));
+    group.wait();
+}
+
+/**
+ * Perform a stable merge sort on the vector of bids by title (or by another
+ * order) using a thread pool. Both halves of each range and both halves of each merge
+ * run as separate tasks.
+ *
+ * @param bids Reference to the vector<Bid> to be sorted
+ * @param pool The pool to run on
+ * @param order The sort order, TitleOrder by default
+ */
+template <typename Order>
+void parallelMergeSort(vector<Bid>& bids, ThreadPool& pool, Order order) {
+    vector<Bid> scratch(bids.size()); // Second buffer the merges ping-pong with
+    mergeSortRange(bids, scratch, 0, bids.size(), false, pool, order);
+}
+
+/**
+ * Merge sort worker: sorts bids[begin..end) and leaves the result in
+ * scratch or in bids. Halves are sorted into the other buffer so each
+ * level needs just one merge and no copy back.
+ *
+ * @param bids The bids being sorted
+ * @param scratch A buffer as large as bids
+ * @param begin Starting index for the sort
+ * @param end One past the last index for the sort
+ * @param intoScratch Whether the sorted range should end up in scratch
+ * @param pool The pool to run on
+ * @param order The sort order
+ */
+template <typename Order>
+void mergeSortRange(vector<Bid>& bids, vector<Bid>& scratch, size_t begin, size_t end,
+                    bool intoScratch, ThreadPool& pool, Order order) {
+    const size_t MERGE_CUTOFF = 8 * 1024; // Ranges this small are sorted serially
+
+    if (end - begin <= MERGE_CUTOFF) {
+        stable_sort(bids.begin() + begin, bids.begin() + end, order);
+        if (intoScratch) {
+            copy(bids.begin() + begin, bids.begin() + end, scratch.begin() + begin);
+        }
+        return;
+    }
+
+    size_t mid = begin + (end - begin) / 2; // Split point
+    TaskGroup group(pool);
+    group.run([&bids, &scratch, begin, mid, intoScratch, &pool, order] {
+        mergeSortRange(bids, scratch, begin, mid, !intoScratch, pool, order);
+    });
+    mergeSortRange(bids, scratch, mid, end, !intoScratch, pool, order);
+    group.wait();
+
+    // The halves are in the other buffer; merge them into this one
+    const vector<Bid>& src = intoScratch ? bids : scratch;
+    vector<Bid>& dst = intoScratch ? scratch : bids;
+    parallelMerge(src, begin, mid, mid, end, dst, begin, pool, order);
+}
+
+/**
+ * Stable merge of src[lo1..hi1) and src[lo2..hi2) into dst starting at out.
+ * Large merges are split at the middle of the longer run and a binary
+ * search in the shorter one, and both parts are merged concurrently.
+ *
+ * @param src Buffer holding both sorted runs
+ * @param lo1 Start of the first (earlier) run
+ * @param hi1 End of the first run
+ * @param lo2 Start of the second run
+ * @param hi2 End of the second run
+ * @param dst Buffer receiving the merged run
+ * @param out Where the merged run starts in dst
+ * @param pool The pool to run on
+ * @param order The sort order
+ */
+template <typename Order>
+void parallelMerge(const vector<Bid>& src, size_t lo1, size_t hi1, size_t lo2, size_t hi2,
+                   vector<Bid>& dst, size_t out, ThreadPool& pool, Order order) {
+    const size_t MERGE_CUTOFF = 8 * 1024; // Merges this small run serially
+
+    if ((hi1 - lo1) + (hi2 - lo2) <= MERGE_CUTOFF) {
+        // Take from the first run unless the second is strictly smaller
+        while (lo1 < hi1 && lo2 < hi2) {
+            dst[out++] = order(src[lo2], src[lo1]) ? src[lo2++] : src[lo1++];
+        }
+        copy(src.begin() + lo1, src.begin() + hi1, dst.begin() + out);
+        copy(src.begin() + lo2, src.begin() + hi2, dst.begin() + out + (hi1 - lo1));
+        return;
+    }
+
+    size_t mid1; // Split point in the first run
+    size_t mid2; // Split point in the second run
+    if (hi1 - lo1 >= hi2 - lo2) {
+        // Second-run bids equal to the split bid go after it, keeping the order stable
+        mid1 = lo1 + (hi1 - lo1) / 2;
+        mid2 = lower_bound(src.begin() + lo2, src.begin() + hi2, src[mid1], order) - src.begin();
+    } else {
+        // First-run bids equal to the split bid go before it
+        mid2 = lo2 + (hi2 - lo2) / 2;
+        mid1 = upper_bound(src.begin() + lo1, src.begin() + hi1, src[mid2], order) - src.begin();
+    }
+
+    TaskGroup group(pool);
+    group.run([&src, lo1, mid1, lo2, mid2, &dst, out, &pool, order] {
+        parallelMerge(src, lo1, mid1, lo2, mid2, dst, out, pool, order);
+    });
+    parallelMerge(src, mid1, hi1, mid2, hi2, dst, out + (mid1 - lo1) + (mid2 - lo2), pool, order);
+    group.wait();
+}
+
+/**
+ * Perform selection sort on the vector of bids by title, or by another order.
+ *
+ * @param bids Reference to the vector<Bid> to be sorted
+ * @param order The sort order, TitleOrder by default
+ */
+template <typename Order>
+void selectionSort(vector<Bid>& bids, Order order) {
+    size_t size = bids.size(); // Get the size of the bids vector
+    if (size < 2) {
+        return; // Nothing to order
+    }
+
+    // Iterate through each position in the vector
+    for (size_t pos = 0; pos < size - 1; pos++) {
+        size_t minIndex = pos; // Assume the current position is the minimum
+        // Find the minimum element in the remaining unsorted portion
+        for (size_t j = pos + 1; j < size; j++) {
+            if (order(bids[j], bids[minIndex])) {
+                minIndex = j; // Update the index of the minimum element
+            }
+        }
+        // Swap the found minimum element with the element at the current position
+        swap(bids[pos], bids[minIndex]);
+        STATS_ADD(SWAPS, 1);
+    }
+}
+
+/**
+ * Find the first k bids in the given order without reordering the vector,
+ * e.g. topBids(bids, 100, OrderBy<Descending<ByAmount>>()) for the 100
+ * highest winning bids.
+ *
+ * A heap of the best k seen so far (worst on top) is kept, so the scan is
+ * O(n log k) and only k bids are ever copied.
+ *
+ * @param bids The bids to search
+ * @param k How many bids to return
+ * @param order The ranking, TitleOrder by default
+ * @return Up to k bids, best first
+ */
+template <typename Order>
+vector<Bid> topBids(const vector<Bid>& bids, size_t k, Order order) {
+    vector<Bid> best; // Max-heap under order: the worst kept bid is on top
+    if (k == 0) {
+        return best;
+    }
+    best.reserve(min(k, bids.size()));
+
+    for (size_t i = 0; i < bids.size(); i++) {
+        if (best.size() < k) {
+            best.push_back(bids[i]);
+            push_heap(best.begin(), best.end(), order);
+        } else if (order(bids[i], best.front())) {
+            // Better than the worst kept bid; replace it
+            pop_heap(best.begin(), best.end(), order);
+            best.back() = bids[i];
+            push_heap(best.begin(), best.end(), order);
+        }
+    }
+    sort_heap(best.begin(), best.end(), order); // Best first
+    return best;
+}
+
+/**
+ * Check whether the bids are already in the given order.
+ *
+ * @param bids The bids to check
+ * @param order The order to check against, TitleOrder by default
+ * @return true if no bid is out of order
+ */
+template <typename Order>
+bool isSorted(const vector<Bid>& bids, Order order) {
+    for (size_t i = 1; i < bids.size(); i++) {
+        if (order(bids[i], bids[i - 1])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Merge the sorted runs bids[0..mid) and bids[mid..end) in linear time.
+ * Only the second run is copied out, and the merge fills the vector from
+ * the back, so the extra memory is the size of the appended batch. On
+ * ties the earlier bids stay first.
+ *
+ * @param bids Reference to the vector<Bid> holding both runs
+ * @param mid Where the second run starts
+ * @param order The order both runs are sorted in, TitleOrder by default
+ */
+template <typename Order>
+void mergeAppended(vector<Bid>& bids, size_t mid, Order order) {
+    vector<Bid> batch(bids.begin() + mid, bids.end()); // The appended run
+    size_t left = mid; // Bids of the first run not yet placed
+    size_t right = batch.size(); // Bids of the batch not yet placed
+    size_t out = bids.size(); // Slots not yet filled, counted from the back
+
+    while (right > 0) {
+        if (left > 0 && order(batch[right - 1], bids[left - 1])) {
+            bids[--out] = bids[--left]; // Earlier bid is larger; it goes last
+        } else {
+            bids[--out] = batch[--right];
+        }
+    }
+}
+
+/**
+ * Load a CSV file straight into the columns of a BidTable, without
+ * building a Bid per row. The department and fee columns are found by
+ * header name, since the monthly exports don't all carry them or keep
+ * them in one place; a missing fee column reads as NaN.
+ *
+ * @param csvPath the path to the CSV file to load
+ * @param table the table to append the rows to
+ * @return the number of rows added
+ */
+size_t loadBidTable(const string& csvPath, BidTable& table) {
+    size_t before = table.size(); // Rows already in the table
+
+    try {
+        // A small first read is enough to see the header
+        vector<string> header = csv::Reader(csvPath, ',', 1 << 12).getHeader();
+        auto find = [&header](string_view name) {
+            for (size_t i = 0; i < header.size(); i++) {
+                string_view text = header[i]; // Header names may carry trailing spaces
+                while (!text.empty() && text.back() == ' ') text.remove_suffix(1);
+                if (text == name) {
+                    return static_cast<int>(i);
+                }
+            }
+            return -1;
+        };
+        int department = find("Department"); // Position of each optional column, or -1
+        int ccFee = find("CC Fee");
+        int feeTotal = find("Auction Fee Total");
+        int netSales = find("Net Sales");
+
+        csv::Projection columns = bidColumns(); // The Bid columns plus whatever was found
+        for (int column : { department, ccFee, feeTotal, netSales }) {
+            if (column >= 0) {
+                columns.column(column);
+            }
+        }
+
+        csv::Reader file(csvPath, ',', 1 << 20, columns); // Stream the file one chunk at a time
+        file.forEachRow([&](const csv::RowView& row) {
+            double amount = 0.0; // Malformed amounts read as 0, as in addBid
+            uint32_t closeDate = 0; // Likewise for dates
+            parseMoney(row[4], amount);
+            parseDate(row[3], closeDate);
+            auto fee = [&row](int column) {
+                double value = NAN; // Missing column
+                if (column >= 0) {
+                    parseMoney(row[column], value);
+                }
+                return value;
+            };
+
+            table.amounts.push_back(amount);
+            table.fundIds.push_back(table.funds.intern(row[8]));
+            table.closeDates.push_back(closeDate);
+            table.titles.append(row[0]);
+            table.titleOffsets.push_back(table.titles.size());
+            table.ids.append(row[1]);
+            table.idOffsets.push_back(table.ids.size());
+            table.departmentIds.push_back(table.departments.intern(department >= 0 ? row[department] : string_view()));
+            table.ccFees.push_back(fee(ccFee));
+            table.feeTotals.push_back(fee(feeTotal));
+            table.netSales.push_back(fee(netSales));
+        });
+    } catch (csv::Error &e) {
+        cerr << "Error loading CSV: " << e.what() << endl; // Handle CSV errors
+    }
+    return table.size() - before;
+}
+
+/**
+ * Copy bids into the columns of a BidTable, so a scan sees exactly the
+ * bids in memory, appended and edited ones included. A Bid carries no
+ * department or fees, so those rows read as an empty department and NaN.
+ *
+ * @param bids The bids to copy
+ * @param table The table to append the rows to
+ */
+void buildBidTable(const vector<Bid>& bids, BidTable& table) {
+    uint32_t noDepartment = table.departments.intern(string_view()); // Department of every row
+    size_t rows = table.size() + bids.size(); // Rows once the bids are in
+    table.amounts.reserve(rows);
+    table.fundIds.reserve(rows);
+    table.closeDates.reserve(rows);
+    table.titleOffsets.reserve(rows + 1);
+    table.idOffsets.reserve(rows + 1);
+
+    for (const Bid& bid : bids) {
+        table.amounts.push_back(bid.amount);
+        table.fundIds.push_back(table.funds.intern(bid.fund));
+        table.closeDates.push_back(bid.closeDate);
+        table.titles.append(bid.title);
+        table.titleOffsets.push_back(table.titles.size());
+        table.ids.append(bid.bidId);
+        table.idOffsets.push_back(table.ids.size());
+    }
+    table.departmentIds.resize(rows, noDepartment);
+    table.ccFees.resize(rows, NAN);
+    table.feeTotals.resize(rows, NAN);
+    table.netSales.resize(rows, NAN);
+}
+
+/**
+ * Fill in the department and fee columns of a table built from bids by
+ * looking each auction ID up in a CSV file. Rows the file has no record
+ * of, e.g. bids added by hand, keep their empty department and NaN fees.
+ * An ID the file repeats is matched to its records in file order, each
+ * record once, so duplicate bids keep fees of their own.
+ *
+ * @param csvPath The file holding the department and fee columns
+ * @param table The table to fill in
+ * @return the number of rows found in the file
+ */
+size_t joinBidDetails(const string& csvPath, BidTable& table) {
+    BidTable details; // Every record of the file
+    loadBidTable(csvPath, details);
+    const size_t NONE = SIZE_MAX; // End of a chain
+    unordered_map<string_view, size_t> byId; // Auction ID to its first unmatched row in details
+    vector<size_t> nextSame(details.size(), NONE); // Next row with the same ID, in file order
+    byId.reserve(details.size());
+    for (size_t i = details.size(); i-- > 0;) {
+        auto inserted = byId.emplace(details.bidId(i), i);
+        if (!inserted.second) {
+            nextSame[i] = inserted.first->second;
+            inserted.first->second = i;
+        }
+    }
+
+    size_t matched = 0; // Rows found in the file
+    for (size_t i = 0; i < table.size(); i++) {
+        auto found = byId.find(table.bidId(i));
+        if (found == byId.end() || found->second == NONE) {
+            continue;
+        }
+        size_t row = found->second; // Matching row in details
+        found->second = nextSame[row];
+        table.departmentIds[i] = table.departments.intern(details.departments.name(details.departmentIds[row]));
+        table.ccFees[i] = details.ccFees[row];
+        table.feeTotals[i] = details.feeTotals[row];
+        table.netSales[i] = details.netSales[row];
+        matched++;
+    }
+    return matched;
+}
+
+/**
+ * Format an amount with two decimals and no exponent, for totals that
+ * would otherwise print as 1.48472e+07.
+ *
+ * @param amount The amount to format
+ * @return the formatted amount
+ */
+string formatMoney(double amount) {
+    char text[64]; // Enough for any finite double in fixed notation
+    to_chars_result result = to_chars(text, text + sizeof(text), amount, chars_format::fixed, 2);
+    return string(text, result.ptr - text);
+}
+
+/**
+ * Sum, min, max and count of the amounts of one fund's bids. The scan is
+ * branch free: with SSE2 it takes four rows per step, turning the fund
+ * compare into lane masks that select each amount or an identity value,
+ * so it runs at memory speed rather than at the latency of one add.
+ *
+ * @param table The bids to scan
+ * @param fundId The fund to total
+ * @return the totals for the fund
+ */
+AmountTotals totalAmounts(const BidTable& table, uint32_t fundId) {
+    const double* amounts = table.amounts.data(); // Amount column
+    const uint32_t* fundIds = table.fundIds.data(); // Fund column
+    size_t size = table.size(); // Rows to scan
+    AmountTotals totals; // Running totals
+    size_t i = 0; // Next row
+
+#ifdef __SSE2__
+    const __m128i target = _mm_set1_epi32(static_cast<int>(fundId)); // Fund in every lane
+    const __m128d high = _mm_set1_pd(HUGE_VAL); // Identity of min
+    const __m128d low = _mm_set1_pd(-HUGE_VAL); // Identity of max
+    __m128d sums[2] = { _mm_setzero_pd(), _mm_setzero_pd() }; // Rows 0-1 and 2-3 of each step
+    __m128d mins[2] = { high, high };
+    __m128d maxs[2] = { low, low };
+    size_t count = 0; // Matches in the vector part
+
+    for (; i + 4 <= size; i += 4) {
+        __m128i match = _mm_cmpeq_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(fundIds + i)), target);
+        count += __builtin_popcount(_mm_movemask_ps(_mm_castsi128_ps(match)));
+        // Widen the four 32-bit masks to two pairs of 64-bit masks
+        __m128d masks[2] = { _mm_castsi128_pd(_mm_unpacklo_epi32(match, match)),
+                             _mm_castsi128_pd(_mm_unpackhi_epi32(match, match)) };
+        for (int half = 0; half < 2; half++) {
+            __m128d amount = _mm_loadu_pd(amounts + i + 2 * half);
+            __m128d mask = masks[half];
+            __m128d kept = _mm_and_pd(mask, amount); // Amount or 0
+            sums[half] = _mm_add_pd(sums[half], kept);
+            mins[half] = _mm_min_pd(mins[half], _mm_or_pd(kept, _mm_andnot_pd(mask, high)));
+            maxs[half] = _mm_max_pd(maxs[half], _mm_or_pd(kept, _mm_andnot_pd(mask, low)));
+        }
+    }
+
+    double lanes[2]; // One vector spilled for folding
+    for (int half = 0; half < 2; half++) {
+        _mm_storeu_pd(lanes, sums[half]);
+        totals.sum += lanes[0] + lanes[1];
+        _mm_storeu_pd(lanes, mins[half]);
+        totals.min = min(totals.min, min(lanes[0], lanes[1]));
+        _mm_storeu_pd(lanes, maxs[half]);
+        totals.max = max(totals.max, max(lanes[0], lanes[1]));
+    }
+    totals.count = count;
+#endif
+
+    for (; i < size; i++) {
+        bool match = fundIds[i] == fundId; // Selects without branching
+        totals.sum += match ? amounts[i] : 0.0;
+        totals.min = min(totals.min, match ? amounts[i] : HUGE_VAL);
+        totals.max = max(totals.max, match ? amounts[i] : -HUGE_VAL);
+        totals.count += match;
+    }
+    return totals;
+}
+
+/**
+ * Totals for every fund. Funds are few, so a masked scan per fund reads
+ * the two columns a handful of times; past MAX_SCANS funds one pass that
+ * scatters into per-fund totals is cheaper.
+ *
+ * @param table The bids to scan
+ * @return the totals, indexed by fund ID
+ */
+vector<AmountTotals> totalsByFund(const BidTable& table) {
+    static const size_t MAX_SCANS = 16; // Funds worth one scan each
+    vector<AmountTotals> totals(table.funds.size()); // One entry per fund
+
+    if (totals.size() <= MAX_SCANS) {
+        for (uint32_t id = 0; id < totals.size(); id++) {
+            totals[id] = totalAmounts(table, id);
+        }
+        return totals;
+    }
+    for (size_t i = 0; i < table.size(); i++) {
+        AmountTotals& fund = totals[table.fundIds[i]];
+        double amount = table.amounts[i];
+        fund.sum += amount;
+        fund.min = min(fund.min, amount);
+        fund.max = max(fund.max, amount);
+        fund.count++;
+    }
+    return totals;
+}
+
+/**
+ * Group the rows of a table and total every measure per group. The rows
+ * are cut into chunks that run on the pool, each aggregating into its own
+ * table of groups; the chunk tables are merged at the end, so workers
+ * never share a counter. Group keys are interned IDs, which makes each
+ * chunk's table a direct-indexed array rather than a probed hash.
+ *
+ * @param table The rows to group
+ * @param keys The group of each row, e.g. table.fundIds
+ * @param groups Number of distinct keys
+ * @param pool The pool to run on
+ * @return the totals, indexed by key
+ */
+vector<GroupTotals> groupTotals(const BidTable& table, const vector<uint32_t>& keys,
+                                size_t groups, ThreadPool& pool) {
+    static const size_t MIN_CHUNK = 1 << 14; // Rows worth a task of their own
+    size_t size = table.size(); // Rows to group
+    size_t chunks = min<size_t>(pool.size() * 4, max<size_t>(1, size / MIN_CHUNK)); // Tasks to run
+    vector<vector<GroupTotals>> partials(chunks, vector<GroupTotals>(groups)); // One table per chunk
+    const vector<double>* columns[MEASURE_COUNT] = { &table.amounts, &table.ccFees,
+                                                     &table.feeTotals, &table.netSales };
+
+    TaskGroup group(pool);
+    for (size_t chunk = 0; chunk < chunks; chunk++) {
+        group.run([&, chunk]() {
+            vector<GroupTotals>& local = partials[chunk]; // This chunk's groups
+            size_t end = size * (chunk + 1) / chunks; // End of this chunk's rows
+            for (size_t i = size * chunk / chunks; i < end; i++) {
+                GroupTotals& totals = local[keys[i]];
+                totals.rows++;
+                for (size_t m = 0; m < MEASURE_COUNT; m++) {
+                    totals.measures[m].add((*columns[m])[i]);
+                }
+            }
+        });
+    }
+    group.wait();
+
+    for (size_t chunk = 1; chunk < chunks; chunk++) {
+        for (size_t key = 0; key < groups; key++) {
+            partials[0][key].add(partials[chunk][key]);
+        }
+    }
+    return partials[0];
+}
+
+/**
+ * Save the bids of a store as a binary columnar snapshot that
+ * loadSnapshot can map back in without parsing. See SnapshotHeader for
+ * the layout.
+ *
+ * @param store The bids to save
+ * @param path The snapshot file to write
+ */
+void saveSnapshot(const BidStore& store, const string& path) {
+    const vector<Bid>& bids = store.bids; // The bids themselves
+    vector<uint64_t> stringOffsets; // Column of ID and title offsets
+    vector<uint64_t> fundOffsets; // Column of fund name offsets
+    vector<uint64_t> titleKeys; // Column of title prefixes
+    vector<double> amounts; // Column of amounts
+    vector<uint32_t> fundIds; // Column of fund IDs
+    vector<uint32_t> closeDates; // Column of close dates
+    string blob; // All the string bytes
+
+    stringOffsets.reserve(2 * bids.size() + 1);
+    titleKeys.reserve(bids.size());
+    amounts.reserve(bids.size());
+    fundIds.reserve(bids.size());
+    closeDates.reserve(bids.size());
+    for (const Bid& bid : bids) {
+        stringOffsets.push_back(blob.size());
+        blob.append(bid.bidId);
+        stringOffsets.push_back(blob.size());
+        blob.append(bid.title);
+        titleKeys.push_back(bid.titleKey);
+        amounts.push_back(bid.amount);
+        fundIds.push_back(bid.fundId);
+        closeDates.push_back(bid.closeDate);
+    }
+    stringOffsets.push_back(blob.size());
+    for (size_t id = 0; id < store.funds.size(); id++) {
+        fundOffsets.push_back(blob.size());
+        blob.append(store.funds.name(static_cast<uint32_t>(id)));
+    }
+    fundOffsets.push_back(blob.size());
+
+    SnapshotHeader header; // Describes the sections that follow
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.byteOrder = SNAPSHOT_BYTE_ORDER;
+    header.flags = store.sortedByTitle ? SNAPSHOT_SORTED_BY_TITLE : 0;
+    header.count = bids.size();
+    header.fundCount = store.funds.size();
+    header.blobSize = blob.size();
+
+    ofstream out(path, ios::binary); // The snapshot file
+    if (!out) {
+        throw runtime_error("cannot create " + path);
+    }
+    auto section = [&out](const void* data, size_t bytes) {
+        static const char zeros[8] = {}; // Padding to the next section
+        out.write(static_cast<const char*>(data), bytes);
+        out.write(zeros, (8 - bytes % 8) % 8);
+    };
+    section(&header, sizeof(header));
+    section(stringOffsets.data(), stringOffsets.size() * sizeof(uint64_t));
+    section(fundOffsets.data(), fundOffsets.size() * sizeof(uint64_t));
+    section(titleKeys.data(), titleKeys.size() * sizeof(uint64_t));
+    section(amounts.data(), amounts.size() * sizeof(double));
+    section(fundIds.data(), fundIds.size() * sizeof(uint32_t));
+    section(closeDates.data(), closeDates.size() * sizeof(uint32_t));
+    section(blob.data(), blob.size());
+    if (!out.flush()) {
+        throw runtime_error("cannot write " + path);
+    }
+}
+
+/**
+ * Map a snapshot written by saveSnapshot and rebuild the bids on top of
+ * it. Nothing is parsed or copied except the fund names: the bid IDs and
+ * titles are views into the mapping, which the returned store owns.
+ *
+ * @param path The snapshot file to load
+ * @return a store holding the snapshot's bids
+ */
+BidStore loadSnapshot(const string& path) {
+    BidStore store; // Store to hold the mapping and the bids
+    store.snapshot.reset(new csv::MappedFile(path));
+    const char* data = store.snapshot->data(); // Start of the mapping
+    size_t size = store.snapshot->size(); // Bytes mapped
+
+    SnapshotHeader header; // Copy of the fixed header
+    if (size < sizeof(header)) {
+        throw runtime_error(path + " is not a bid snapshot");
+    }
+    memcpy(&header, data, sizeof(header));
+    if (memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) != 0) {
+        throw runtime_error(path + " is not a bid snapshot");
+    }
+    if (header.version != SNAPSHOT_VERSION || header.byteOrder != SNAPSHOT_BYTE_ORDER) {
+        throw runtime_error(path + " was written by an incompatible version or machine");
+    }
+
+    // Work out where each section starts, checking the sizes add up
+    auto padded = [](uint64_t bytes) { return (bytes + 7) / 8 * 8; };
+    uint64_t count = header.count; // Number of bids
+    uint64_t limit = size / 8; // No column can hold more entries than this
+    if (count >= limit || header.fundCount >= limit) {
+        throw runtime_error(path + " is truncated or corrupt");
+    }
+    uint64_t offset = sizeof(header); // Start of the next section
+    uint64_t stringsAt = offset;
+    offset += padded((2 * count + 1) * sizeof(uint64_t));
+    uint64_t fundsAt = offset;
+    offset += padded((header.fundCount + 1) * sizeof(uint64_t));
+    uint64_t keysAt = offset;
+    offset += padded(count * sizeof(uint64_t));
+    uint64_t amountsAt = offset;
+    offset += padded(count * sizeof(double));
+    uint64_t fundIdsAt = offset;
+    offset += padded(count * sizeof(uint32_t));
+    uint64_t closeDatesAt = offset;
+    offset += padded(count * sizeof(uint32_t));
+    uint64_t blobAt = offset;
+    if (header.blobSize > size || offset + header.blobSize > size) {
+        throw runtime_error(path + " is truncated or corrupt");
+    }
+
+    // The mapping is page aligned and every section 8-byte aligned
+    const uint64_t* stringOffsets = reinterpret_cast<const uint64_t*>(data + stringsAt);
+    const uint64_t* fundOffsets = reinterpret_cast<const uint64_t*>(data + fundsAt);
+    const uint64_t* titleKeys = reinterpret_cast<const uint64_t*>(data + keysAt);
+    const double* amounts = reinterpret_cast<const double*>(data + amountsAt);
+    const uint32_t* fundIds = reinterpret_cast<const uint32_t*>(data + fundIdsAt);
+    const uint32_t* closeDates = reinterpret_cast<const uint32_t*>(data + closeDatesAt);
+    const char* blob = data + blobAt;
+
+    // Checks that [begin, end) is a valid slice of the blob
+    auto slice = [&](uint64_t begin, uint64_t end) {
+        if (begin > end || end > header.blobSize) {
+            throw runtime_error(path + " is truncated or corrupt");
+        }
+        return string_view(blob + begin, end - begin);
+    };
+
+    // Interning the names in ID order gives them the same IDs again, so
+    // later appends share the pool
+    for (uint64_t id = 0; id < header.fundCount; id++) {
+        store.funds.intern(slice(fundOffsets[id], fundOffsets[id + 1]));
+    }
+    if (store.funds.size() != header.fundCount) {
+        throw runtime_error(path + " is truncated or corrupt");
+    }
+
+    store.bids.resize(count);
+    for (uint64_t i = 0; i < count; i++) {
+        Bid& bid = store.bids[i]; // The bid being rebuilt
+        bid.bidId = slice(stringOffsets[2 * i], stringOffsets[2 * i + 1]);
+        bid.title = slice(stringOffsets[2 * i + 1], stringOffsets[2 * i + 2]);
+        bid.titleKey = titleKeys[i];
+        bid.amount = amounts[i];
+        bid.fundId = fundIds[i];
+        if (bid.fundId >= header.fundCount) {
+            throw runtime_error(path + " is truncated or corrupt");
+        }
+        bid.fund = store.funds.name(bid.fundId);
+        bid.closeDate = closeDates[i];
+    }
+    store.sortedByTitle = (header.flags & SNAPSHOT_SORTED_BY_TITLE) != 0;
+    return store;
+}
+
+/**
+ * Sort a bid file that may not fit in memory. The file is read in runs
+ * of at most options.memoryBudget bytes of bids; each run is sorted and
+ * spilled to options.tempDir, then the runs are merged through a loser
+ * tree into a CSV of title, auction ID, winning bid and fund. A file
+ * that fits in one run is written straight from memory. The sort is
+ * stable.
+ *
+ * @param csvPath The bid file to sort
+ * @param outPath The sorted CSV to write
+ * @param options Memory budget and temporary directory
+ * @param order The order to sort in, TitleOrder by default
+ * @return the number of bids written
+ */
+template <typename Order>
+size_t externalSort(const string& csvPath, const string& outPath,
+                    const ExternalSortOptions& options, Order order) {
+    static const size_t MAX_FAN_IN = 64; // Runs merged at once; bounds open files
+
+    ofstream out(outPath, ios::binary); // The sorted output
+    if (!out) {
+        throw runtime_error("cannot create " + outPath);
+    }
+    writeCsvHeader(out);
+
+    // Each bid costs its own size, a scratch copy for mergeSort and its strings
+    size_t budget = max<size_t>(options.memoryBudget, 1 << 16); // Never less than a sliver
+    BidStore store; // The run being collected
+    size_t bytes = 0; // Estimated memory held by store
+    size_t total = 0; // Bids read so far
+    size_t malformed = 0; // Rows whose winning bid could not be parsed
+    TempRuns runs; // Spilled runs, removed on the way out
+    random_device seed; // Keeps concurrent sorts in one directory apart
+    string prefix = "bids-" + to_string(seed()) + "-"; // Common run file prefix
+
+    auto spill = [&]() {
+        mergeSort(store.bids, order);
+        string path = (filesystem::path(options.tempDir) / (prefix + to_string(runs.paths.size()) + ".run")).string();
+        runs.paths.push_back(path);
+        ofstream run(path, ios::binary); // Spill file for this run
+        for (const Bid& bid : store.bids) {
+            writeRunRecord(run, bid);
+        }
+        if (!run.flush()) {
+            throw runtime_error("cannot write run " + path);
+        }
+        // Keep the fund pool so fund IDs mean the same thing in every run
+        store.bids.clear();
+        store.strings.clear();
+        bytes = 0;
+    };
+
+    csv::Reader file(csvPath, ',', 1 << 20, bidColumns()); // Bounded read-ahead
+    while (file.next()) {
+        if (!addBid(file.row(), store)) {
+            malformed++;
+        }
+        const Bid& bid = store.bids.back();
+        bytes += 2 * sizeof(Bid) + bid.bidId.size() + bid.title.size();
+        total++;
+        if (bytes >= budget) {
+            spill();
+        }
+    }
+    if (malformed != 0) {
+        cerr << malformed << " bids had a malformed winning bid (read as 0)" << endl;
+    }
+
+    if (runs.paths.empty()) {
+        // Everything fit: no temporary files needed
+        mergeSort(store.bids, order);
+        for (const Bid& bid : store.bids) {
+            writeCsvRecord(out, bid);
+        }
+    } else {
+        if (!store.bids.empty()) {
+            spill();
+        }
+        // Merge passes until one final merge can take every run
+        for (size_t pass = 1; runs.paths.size() > MAX_FAN_IN; pass++) {
+            TempRuns merged; // Output of this pass
+            for (size_t first = 0; first < runs.paths.size(); first += MAX_FAN_IN) {
+                vector<string> group(runs.paths.begin() + first,
+                                     runs.paths.begin() + min(first + MAX_FAN_IN, runs.paths.size()));
+                string path = (filesystem::path(options.tempDir)
+                               / (prefix + to_string(pass) + "-" + to_string(merged.paths.size()) + ".run")).string();
+                merged.paths.push_back(path);
+                ofstream run(path, ios::binary); // Spill file for the merged group
+                mergeRuns(group, order, store.funds, [&run](const Bid& bid) { writeRunRecord(run, bid); });
+                if (!run.flush()) {
+                    throw runtime_error("cannot write run " + path);
+                }
+            }
+            runs.removeAll();
+            swap(runs.paths, merged.paths);
+        }
+        mergeRuns(runs.paths, order, store.funds, [&out](const Bid& bid) { writeCsvRecord(out, bid); });
+    }
+
+    if (!out.flush()) {
+        throw runtime_error("cannot write " + outPath);
+    }
+    return total;
+}
+
+/**
+ * k-way merge of sorted run files through a loser tree.
+ *
+ * @param paths The runs, in the order they were written
+ * @param order The order every run is sorted in
+ * @param funds The pool the runs' fund IDs were assigned from
+ * @param sink Called with each bid in merged order
+ */
+template <typename Order>
+void mergeRuns(const vector<string>& paths, Order order, StringPool& funds,
+               const function<void(const Bid&)>& sink) {
+    vector<unique_ptr<RunReader>> runs; // One reader per run
+    for (const string& path : paths) {
+        runs.emplace_back(new RunReader(path, funds));
+    }
+    if (runs.empty()) {
+        return;
+    }
+
+    LoserTree<Order> tree(runs, order);
+    while (!runs[tree.winner()]->done()) {
+        RunReader& run = *runs[tree.winner()]; // Holds the smallest bid left
+        sink(run.bid());
+        run.next();
+        tree.replay();
+    }
+}
+
+/**
+ * Read the next bid of a run. A record is the lengths and bytes of the
+ * bid ID, title and fund followed by the amount and close date, all in
+ * native layout.
+ *
+ * @return false once the run is used up
+ */
+bool RunReader::next() {
+    double amount = 0.0; // Amount of the bid being read
+    uint32_t closeDate = 0; // Close date of the bid being read
+    if (!readString(bidId) || !readString(title) || !readString(fund)
+        || !input.read(reinterpret_cast<char*>(&amount), sizeof(amount))
+        || !input.read(reinterpret_cast<char*>(&closeDate), sizeof(closeDate))) {
+        exhausted = true;
+        return false;
+    }
+    current.bidId = bidId;
+    current.title = title;
+    current.titleKey = titlePrefix(current.title);
+    current.fundId = funds.intern(fund);
+    current.fund = funds.name(current.fundId);
+    current.amount = amount;
+    current.closeDate = closeDate;
+    return true;
+}
+
+// Read one length-prefixed string of a run record
+bool RunReader::readString(string& text) {
+    uint32_t length = 0; // Length of the string in bytes
+    if (!input.read(reinterpret_cast<char*>(&length), sizeof(length))) {
+        return false;
+    }
+    text.resize(length);
+    return length == 0 || input.read(&text[0], length);
+}
+
+/**
+ * Append one bid to a run file in the format RunReader::next reads.
+ *
+ * @param out The run file
+ * @param bid The bid to write
+ */
+void writeRunRecord(ostream& out, const Bid& bid) {
+    string_view fields[] = { bid.bidId, bid.title, bid.fund }; // Strings in record order
+    for (string_view field : fields) {
+        uint32_t length = static_cast<uint32_t>(field.size()); // Fields are far below 4 GiB
+        out.write(reinterpret_cast<const char*>(&length), sizeof(length));
+        out.write(field.data(), field.size());
+    }
+    out.write(reinterpret_cast<const char*>(&bid.amount), sizeof(bid.amount));
+    out.write(reinterpret_cast<const char*>(&bid.closeDate), sizeof(bid.closeDate));
+}
+
+/**
+ * Write the header line of a sorted bid CSV.
+ *
+ * @param out The CSV being written
+ */
+void writeCsvHeader(ostream& out) {
+    out << "Title,Auction ID,Winning Bid,Fund\n";
+}
+
+/**
+ * Write one bid as a CSV line. The parser hands fields over as they
+ * appear in the file, quotes and all, so they are written back as is.
+ *
+ * @param out The CSV being written
+ * @param bid The bid to write
+ */
+void writeCsvRecord(ostream& out, const Bid& bid) {
+    char amount[32]; // Amount with two decimals
+    to_chars_result result = to_chars(amount, amount + sizeof(amount), bid.amount, chars_format::fixed, 2);
+
+    out << bid.title << ',' << bid.bidId << ',' << string_view(amount, result.ptr - amount)
+        << ',' << bid.fund << '\n';
+}
+
+/**
+ * Parse a money or decimal field such as "$1.00 ", "\"$3,000 \"" or "-0.23"
+ * without allocating. Surrounding quotes and spaces, a '$' and thousands
+ * separators are accepted. An empty field reads as 0.
+ *
+ * @param field The raw field text
+ * @param value Receives the parsed value, or 0 if the field is malformed
+ * @return true if the field held a valid number
+ */
+bool parseMoney(string_view field, double& value) {
+    value = 0.0;
+
+    // Trim spaces, then an enclosing pair of quotes, then spaces again
+    auto trim = [](string_view text) {
+        while (!text.empty() && text.front() == ' ') text.remove_prefix(1);
+        while (!text.empty() && text.back() == ' ') text.remove_suffix(1);
+        return text;
+    };
+    field = trim(field);
+    if (field.size() >= 2 && field.front() == '"' && field.back() == '"') {
+        field = trim(field.substr(1, field.size() - 2));
+    }
+    if (field.empty()) {
+        return true;
+    }
+
+    // Copy sign, digits and decimal point into a small stack buffer
+    char digits[64]; // Long enough for any sane amount
+    size_t length = 0; // Characters used in digits
+    size_t pos = 0; // Position in field
+    bool seenDigit = false; // A comma is only valid after a digit
+    bool seenPoint = false; // Only one decimal point is allowed
+
+    if (field[pos] == '-') digits[length++] = field[pos++];
+    if (pos < field.size() && field[pos] == '$') pos++;
+    if (length == 0 && pos < field.size() && field[pos] == '-') digits[length++] = field[pos++];
+
+    for (; pos < field.size(); pos++) {
+        char ch = field[pos];
+        if (ch >= '0' && ch <= '9') {
+            seenDigit = true;
+        } else if (ch == ',' && seenDigit && !seenPoint) {
+            continue; // Thousands separator
+        } else if (ch == '.' && !seenPoint) {
+            seenPoint = true;
+        } else {
+            return false; // Unexpected character
+        }
+        if (length == sizeof(digits)) {
+            return false; // Too long to be an amount
+        }
+        digits[length++] = ch;
+    }
+    if (!seenDigit) {
+        return false;
+    }
+
+    double parsed = 0.0; // Result of the conversion
+    from_chars_result result = from_chars(digits, digits + length, parsed);
+    if (result.ec != errc() || result.ptr != digits + length) {
+        return false;
+    }
+    value = parsed;
+    return true;
+}
+
+/**
+ * Parse a date field written m/d/yyyy, such as "6/9/2014 ", into a
+ * yyyymmdd integer that orders like the dates. Surrounding quotes and
+ * spaces are accepted. An empty field reads as 0.
  *
- * @param bid struct containing the bid info
+ * @param field The raw field text
+ * @param date Receives the date, or 0 if the field is malformed
+ * @return true if the field held a valid date
  */
-void displayBid(const Bid& bid) {
-    cout << bid.bidId << ": " << bid.title << " | " << bid.amount << " | "
-         << bid.fund << endl;
+bool parseDate(string_view field, uint32_t& date) {
+    date = 0;
+    while (!field.empty() && (field.front() == ' ' || field.front() == '"')) field.remove_prefix(1);
+    while (!field.empty() && (field.back() == ' ' || field.back() == '"')) field.remove_suffix(1);
+    if (field.empty()) {
+        return true;
+    }
+
+    unsigned parts[3] = {}; // Month, day and year
+    const char* pos = field.data(); // Start of the next part
+    const char* end = field.data() + field.size(); // End of the field
+    for (int i = 0; i < 3; i++) {
+        from_chars_result result = from_chars(pos, end, parts[i]);
+        if (result.ec != errc() || (i < 2 ? (result.ptr == end || *result.ptr != '/') : result.ptr != end)) {
+            return false;
+        }
+        pos = result.ptr + 1;
+    }
+    if (parts[0] < 1 || parts[0] > 12 || parts[1] < 1 || parts[1] > 31 || parts[2] > 9999) {
+        return false;
+    }
+    date = parts[2] * 10000 + parts[0] * 100 + parts[1];
+    return true;
 }
 
 /**
- * Load a CSV file containing bids into a vector.
+ * Sort bids with one of the comparison sorts, in any order.
  *
- * @param csvPath the path to the CSV file to load
- * @return a vector holding all the bids read from the CSV
+ * @param bids The bids to sort
+ * @param engine selection, quick, quick3, merge, parallel or parallel-merge
+ * @param pool Workers for the parallel sorts; may be null for the others
+ * @param order The order to sort into
+ * @return false if the engine is not one of these
  */
-vector<Bid> loadBids(const string& csvPath) {
-    cout << "Loading CSV file " << csvPath << endl;
-
-    vector<Bid> bids; // Vector to hold loaded bids
-    csv::Parser file = csv::Parser(csvPath); // Initialize CSV parser
-
-    try {
-        // Loop through each row of the CSV file
-        for (int i = 0; i < file.rowCount(); i++) {
-            Bid bid; // Create a new Bid instance
-            bid.bidId = file[i][1]; // Read bid ID
-            bid.title = file[i][0];  // Read title
-            bid.fund = file[i][8];   // Read fund
-            bid.amount = strToDouble(file[i][4], '$'); // Convert amount string to double
+template <typename Order>
+bool sortWith(vector<Bid>& bids, const string& engine, ThreadPool* pool, Order order) {
+    if (engine == "selection") {
+        selectionSort(bids, order);
+    } else if (engine == "quick") {
+        quickSort(bids, 0, bids.size() - 1, order);
+    } else if (engine == "quick3") {
+        quickSort3Way(bids, 0, bids.size() - 1, order);
+    } else if (engine == "merge") {
+        mergeSort(bids, order);
+    } else if (engine == "parallel") {
+        parallelQuickSort(bids, *pool, order);
+    } else if (engine == "parallel-merge") {
+        parallelMergeSort(bids, *pool, order);
+    } else {
+        return false;
+    }
+    return true;
+}
 
-            bids.push_back(bid); // Add the bid to the vector
+/**
+ * Sort bids on a key with a named engine. The comparison sorts take
+ * every key; the index and radix sorts only the keys they were built for.
+ *
+ * @param bids The bids to sort
+ * @param engine See sortWith, plus index, radix and radix-numeric (LSD
+ *               on numeric auction IDs, non-numeric ones last)
+ * @param key title, id, amount (lowest first), amount-desc (highest
+ *            first, then title) or fund (fund, amount desc, title)
+ * @param pool Workers for the parallel sorts; may be null for the others
+ * @return false if the engine cannot sort on the key
+ */
+bool sortBids(vector<Bid>& bids, const string& engine, const string& key, ThreadPool* pool) {
+    if (engine == "index") {
+        if (key != "title") {
+            return false;
         }
-    } catch (csv::Error &e) {
-        cerr << "Error loading CSV: " << e.what() << endl; // Handle CSV errors
+        applyPermutation(bids, sortedIndex(bids));
+        return true;
+    }
+    if (engine == "radix") {
+        if (key == "title" || key == "id") {
+            radixSort(bids, key == "title" ? &Bid::title : &Bid::bidId);
+        } else if (key == "amount") {
+            radixSortByAmount(bids);
+        } else {
+            return false;
+        }
+        return true;
+    }
+    if (engine == "radix-numeric") {
+        if (key == "id") {
+            radixSortByAuctionId(bids);
+        } else if (key == "amount") {
+            radixSortByAmount(bids);
+        } else {
+            return false;
+        }
+        return true;
+    }
+    if (key == "title") {
+        return sortWith(bids, engine, pool, TitleOrder());
+    } else if (key == "id") {
+        return sortWith(bids, engine, pool, OrderBy<ByAuctionId>());
+    } else if (key == "amount") {
+        return sortWith(bids, engine, pool, OrderBy<ByAmount>());
+    } else if (key == "amount-desc") {
+        return sortWith(bids, engine, pool, OrderBy<Descending<ByAmount>, ByTitle>());
+    } else if (key == "fund") {
+        return sortWith(bids, engine, pool, OrderBy<ByFund, Descending<ByAmount>, ByTitle>());
     }
-    return bids;
+    return false;
 }
 
 /**
- * Partition the vector of bids into two parts for quick sort.
+ * Whether batch mode can sort on a key with an engine, per BATCH_SORTS.
+ * With an empty engine, whether any engine sorts on the key.
  *
- * @param bids Reference to the vector<Bid> to be partitioned
- * @param begin Starting index for the partition
- * @param end Ending index for the partition
- * @return Index of the pivot after partitioning
+ * @param engine The sort's name, or empty
+ * @param key The key's name
+ * @return true if the pair is in the table
  */
-int partition(vector<Bid>& bids, int begin, int end) {
-    string pivot = bids[(begin + end) / 2].title; // Choose the middle element as pivot
-    int low = begin; // Initialize low index
-    int high = end;  // Initialize high index
-
-    while (true) {
-        // Increment low index while the bid title is less than the pivot
-        while (bids[low].title < pivot) low++;
-        // Decrement high index while the bid title is greater than the pivot
-        while (pivot < bids[high].title) high--;
-
-        if (low >= high) return high; // If indices cross, return high index
-
-        // Swap the elements at low and high indices
-        swap(bids[low], bids[high]);
-        low++; // Move low index up
-        high--; // Move high index down
+bool canSort(const string& engine, const string& key) {
+    for (const BatchSort& sort : BATCH_SORTS) {
+        if (!engine.empty() && engine != sort.engine) {
+            continue;
+        }
+        for (const char* name : sort.keys) {
+            if (name != nullptr && key == name) {
+                return true;
+            }
+        }
     }
+    return false;
 }
 
 /**
- * Perform quick sort on the vector of bids by title.
+ * Whether a batch sort runs on the thread pool, per BATCH_SORTS.
  *
- * @param bids Reference to the vector<Bid> to be sorted
- * @param begin Starting index for the sort
- * @param end Ending index for the sort
+ * @param engine The sort's name
+ * @return false for serial and unknown engines
  */
-void quickSort(vector<Bid>& bids, int begin, int end) {
-    if (begin < end) {
-        int mid = partition(bids, begin, end); // Partition the bids
-        quickSort(bids, begin, mid); // Recursively sort left partition
-        quickSort(bids, mid + 1, end); // Recursively sort right partition
+bool isParallelSort(const string& engine) {
+    for (const BatchSort& sort : BATCH_SORTS) {
+        if (engine == sort.engine) {
+            return sort.parallel;
+        }
     }
+    return false;
 }
 
 /**
- * Perform selection sort on the vector of bids by title.
+ * Select the first k bids of a key's order without sorting the rest.
  *
- * @param bids Reference to the vector<Bid> to be sorted
+ * @param bids The bids to choose from
+ * @param k How many to keep
+ * @param key As for sortBids
+ * @param top Receives the selected bids, in order
+ * @return false for an unknown key
  */
-void selectionSort(vector<Bid>& bids) {
-    int size = bids.size(); // Get the size of the bids vector
-
-    // Iterate through each position in the vector
-    for (size_t pos = 0; pos < size - 1; pos++) {
-        int minIndex = pos; // Assume the current position is the minimum
-        // Find the minimum element in the remaining unsorted portion
-        for (size_t j = pos + 1; j < size; j++) {
-            if (bids[j].title < bids[minIndex].title) {
-                minIndex = j; // Update the index of the minimum element
-            }
-        }
-        // Swap the found minimum element with the element at the current position
-        swap(bids[pos], bids[minIndex]);
+bool topBidsBy(const vector<Bid>& bids, size_t k, const string& key, vector<Bid>& top) {
+    if (key == "title") {
+        top = topBids(bids, k, TitleOrder());
+    } else if (key == "id") {
+        top = topBids(bids, k, OrderBy<ByAuctionId>());
+    } else if (key == "amount") {
+        top = topBids(bids, k, OrderBy<ByAmount>());
+    } else if (key == "amount-desc") {
+        top = topBids(bids, k, OrderBy<Descending<ByAmount>, ByTitle>());
+    } else if (key == "fund") {
+        top = topBids(bids, k, OrderBy<ByFund, Descending<ByAmount>, ByTitle>());
+    } else {
+        return false;
     }
+    return true;
 }
 
 /**
- * Convert a string to a double after stripping out unwanted characters.
+ * Run a whole load, sort and emit pipeline from the command line, with
+ * no prompts. Progress and timings go to stderr, one "step rows=N ms=T"
+ * line per step with wall-clock milliseconds, so stdout carries only the
+ * bids when the output is "-".
  *
- * @param str The input string to convert
- * @param ch The character to strip out
- * @return The converted double value
+ * Options: --load PATH (repeat to append more files; a bare PATH works
+ * too), --sort ENGINE, --key KEY, --top N, --output PATH|-, --threads N
+ * (parallel engines only) and --stats. Values may also be given as
+ * --option=value. Every argument is checked before any work starts.
+ *
+ * @param argc Argument count from main
+ * @param argv Arguments from main
+ * @return 0 on success, 1 if a step failed, 2 for bad arguments
  */
-double strToDouble(string str, char ch) {
-    str.erase(remove(str.begin(), str.end(), ch), str.end()); // Remove specified character
-    return atof(str.c_str()); // Convert the string to double
+int runBatch(int argc, char* argv[]) {
+    vector<string> loadPaths; // Files to load, in order
+    string engine; // Sort to run; empty for none
+    string key = "title"; // Order to sort or select in
+    size_t top = 0; // Bids to emit; 0 for all
+    bool hasTop = false; // Whether --top was given
+    string outputPath; // Where to emit the bids; empty for nowhere
+    unsigned int threadCount = 0; // Threads for the parallel sorts; 0 means all cores
+    bool hasThreads = false; // Whether --threads was given
+    bool showStats = false; // Whether to print the counters at the end
+
+    const char* usage = "usage: VectorSorting --load PATH [--load PATH ...] [--sort ENGINE] [--key KEY]\n"
+                        "                     [--top N] [--output PATH|-] [--threads N] [--stats]\n"
+                        "  engines: selection, quick, quick3, index, radix, radix-numeric,\n"
+                        "           merge, parallel, parallel-merge\n"
+                        "  keys:    title, id, amount, amount-desc, fund";
+    try {
+        for (int i = 1; i < argc; i++) {
+            string arg = argv[i];
+            string value; // The option's value, after '=' or as the next argument
+            size_t equals = arg.find('=');
+            bool hasValue = arg.rfind("--", 0) == 0 && equals != string::npos;
+            if (hasValue) {
+                value = arg.substr(equals + 1);
+                arg.erase(equals);
+            }
+            auto next = [&]() {
+                if (!hasValue) {
+                    if (i + 1 >= argc) {
+                        throw invalid_argument(arg + " needs a value");
+                    }
+                    value = argv[++i];
+                }
+                return value;
+            };
+            auto number = [&]() {
+                string text = next();
+                if (text.empty() || text.find_first_not_of("0123456789") != string::npos) {
+                    throw invalid_argument(arg + " needs a number, not '" + text + "'");
+                }
+                if (text.size() > 9) {
+                    throw invalid_argument(arg + " is out of range");
+                }
+                return stoull(text);
+            };
+
+            if (arg == "--load") {
+                loadPaths.push_back(next());
+            } else if (arg == "--sort") {
+                engine = next();
+            } else if (arg == "--key") {
+                key = next();
+            } else if (arg == "--top") {
+                top = number();
+                hasTop = true;
+            } else if (arg == "--output") {
+                outputPath = next();
+            } else if (arg == "--threads") {
+                threadCount = static_cast<unsigned int>(number());
+                hasThreads = true;
+            } else if (arg == "--stats") {
+                showStats = true;
+            } else if (arg == "--help") {
+                cout << usage << endl;
+                return 0;
+            } else if (!arg.empty() && arg[0] != '-') {
+                loadPaths.push_back(arg); // A bare path, as in menu mode
+            } else {
+                throw invalid_argument("unknown option " + arg);
+            }
+        }
+    } catch (const exception& e) {
+        cerr << e.what() << endl << usage << endl;
+        return 2;
+    }
+    if (loadPaths.empty()) {
+        cerr << "nothing to load" << endl << usage << endl;
+        return 2;
+    }
+    if (!engine.empty() && !canSort(engine, key)) {
+        cerr << "cannot sort with " << engine << " on " << key << endl << usage << endl;
+        return 2;
+    }
+    if (hasTop && engine.empty() && !canSort("", key)) {
+        cerr << "unknown key " << key << endl << usage << endl;
+        return 2;
+    }
+    if (hasThreads && !isParallelSort(engine)) {
+        cerr << "--threads needs a parallel engine (parallel, parallel-merge)" << endl << usage << endl;
+        return 2;
+    }
+    unique_ptr<ThreadPool> pool; // Started only once the arguments are known good
+    if (isParallelSort(engine)) {
+        pool.reset(new ThreadPool(threadCount));
+    }
+
+    auto report = [](const char* step, size_t rows, chrono::steady_clock::time_point start) {
+        chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+        cerr << step << " rows=" << rows << " ms=" << elapsed.count() << endl;
+    };
+    chrono::steady_clock::time_point begin = chrono::steady_clock::now(); // Start of the whole run
+    BidStore store; // Every loaded bid
+    vector<Bid>& bids = store.bids; // The bids themselves
+
+    {
+        STATS_PHASE("load");
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        streambuf* console = cout.rdbuf(cerr.rdbuf()); // Keep the loaders' messages off stdout
+        for (size_t i = 0; i < loadPaths.size(); i++) {
+            if (i == 0) {
+                store = loadBids(loadPaths[i]);
+            } else {
+                appendBids(loadPaths[i], store);
+            }
+        }
+        cout.rdbuf(console);
+        report("load", bids.size(), start);
+    }
+    if (bids.empty()) {
+        cerr << "no bids loaded" << endl;
+        return 1;
+    }
+
+    if (!engine.empty()) {
+        STATS_PHASE("sort");
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        sortBids(bids, engine, key, pool.get());
+        report("sort", bids.size(), start);
+    }
+
+    vector<Bid> selected; // The bids to emit when only the first N are wanted
+    if (hasTop) {
+        STATS_PHASE("display");
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        if (!engine.empty()) {
+            selected.assign(bids.begin(), bids.begin() + min(top, bids.size())); // Already in order
+        } else {
+            topBidsBy(bids, top, key, selected);
+        }
+        report("top", selected.size(), start);
+    }
+
+    if (!outputPath.empty()) {
+        STATS_PHASE("display");
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        const vector<Bid>& emitted = hasTop ? selected : bids; // What goes out
+        try {
+            exportBids(emitted, outputPath);
+        } catch (const exception& e) {
+            cerr << "Export failed: " << e.what() << endl;
+            return 1;
+        }
+        report("output", emitted.size(), start);
+    }
+
+    report("total", bids.size(), begin);
+    if (showStats) {
+        displayStats(cerr);
+    }
+    return 0;
 }
 
+#ifndef VECTORSORTING_NO_MAIN // Defined by programs that reuse these functions, e.g. Benchmark.cpp
 /**
  * The main function that drives the program.
  */
 int main(int argc, char* argv[]) {
+    for (int i = 1; i < argc; i++) {
+        if (argv[i][0] == '-' && argv[i][1] == '-') {
+            return runBatch(argc, argv); // Options given: run once, no menu
+        }
+    }
+
     string csvPath; // Variable to hold the path to the CSV file
     switch (argc) {
     case 2:
@@ -176,9 +3174,12 @@ int main(int argc, char* argv[]) {
         csvPath = "eBid_Monthly_Sales.csv"; // Default path
     }
 
-    vector<Bid> bids; // Vector to hold all bids
+    BidStore store; // Store to hold all bids
+    vector<Bid>& bids = store.bids; // The bids themselves
     clock_t ticks; // Timer variable
     int choice = 0; // User's menu choice
+    unsigned int threadCount = 0; // Threads for the parallel sorts; 0 means all cores
+    unique_ptr<ThreadPool> pool; // Created on first use
 
     while (choice != 9) {
         // Display menu options
@@ -187,14 +3188,52 @@ int main(int argc, char* argv[]) {
         cout << "  2. Display All Bids" << endl;
         cout << "  3. Selection Sort All Bids" << endl;
         cout << "  4. Quick Sort All Bids" << endl;
+        cout << "  5. Three-Way Quick Sort All Bids" << endl;
+        cout << "  6. Index Sort All Bids" << endl;
+        cout << "  7. Radix Sort All Bids" << endl;
+        cout << "  8. Radix Sort All Bids by Auction ID" << endl;
+        cout << " 10. Radix Sort All Bids by Amount" << endl;
+        cout << " 11. Radix Sort All Bids by Numeric Auction ID" << endl;
+        cout << " 12. Parallel Quick Sort All Bids" << endl;
+        cout << " 13. Parallel Merge Sort All Bids (stable)" << endl;
+        cout << " 14. Set Thread Count" << endl;
+        cout << " 15. Sort All Bids by Fund, Amount (desc), Title (stable)" << endl;
+        cout << " 16. Display Top N Bids" << endl;
+        cout << " 17. Append Bids from File" << endl;
+        cout << " 18. External Sort File to CSV" << endl;
+        cout << " 19. Save Snapshot" << endl;
+        cout << " 20. Load Snapshot" << endl;
+        cout << " 21. Export All Bids to File" << endl;
+        cout << " 22. Find Bid by Auction ID" << endl;
+        cout << " 23. Delete Bid by Auction ID" << endl;
+        cout << " 24. Add or Update Bid" << endl;
+        cout << " 25. Find Bids by Amount and Close Date" << endl;
+        cout << " 26. Total Amounts by Fund" << endl;
+        cout << " 27. Totals by Fund or Department (parallel)" << endl;
+        cout << " 28. Display Statistics" << endl;
         cout << "  9. Exit" << endl;
         cout << "Enter choice: ";
         cin >> choice; // Get user's choice
 
+        if ((choice == 12 || choice == 13 || choice == 27) && !pool) {
+            pool.reset(new ThreadPool(threadCount)); // Start the workers on first use
+        }
+
+        bool titleSort = (choice >= 3 && choice <= 7) || choice == 12 || choice == 13; // Sorts into TitleOrder
+        if (titleSort && store.sortedByTitle) {
+            cout << bids.size() << " bids already sorted by title" << endl;
+            continue; // Nothing to do
+        }
+        if (choice == 28) {
+            displayStats();
+            continue;
+        }
+        STATS_PHASE(phaseName(choice)); // Counts until the end of this choice
+
         switch (choice) {
         case 1: // Load bids from CSV
             ticks = clock(); // Start timer
-            bids = loadBids(csvPath); // Load bids
+            store = loadBids(csvPath); // Load bids
             cout << bids.size() << " bids read" << endl; // Display number of bids read
             ticks = clock() - ticks; // Calculate elapsed time
             cout << "time: " << ticks << " clock ticks" << endl;
@@ -202,9 +3241,7 @@ int main(int argc, char* argv[]) {
             break;
 
         case 2: // Display all bids
-            for (int i = 0; i < bids.size(); ++i) {
-                displayBid(bids[i]); // Display each bid
-            }
+            displayBids(bids); // Display each bid, buffered
             cout << endl;
             break;
 
@@ -225,9 +3262,334 @@ int main(int argc, char* argv[]) {
             cout << "time: " << ticks << " clock ticks" << endl;
             cout << "time: " << ticks * 1.0 / CLOCKS_PER_SEC << " seconds" << endl;
             break;
+
+        case 5: // Perform three-way quick sort
+            ticks = clock(); // Start timer
+            quickSort3Way(bids, 0, bids.size() - 1); // Sort bids, grouping equal titles
+            ticks = clock() - ticks; // Calculate elapsed time
+            cout << bids.size() << " bids sorted" << endl;
+            cout << "time: " << ticks << " clock ticks" << endl;
+            cout << "time: " << ticks * 1.0 / CLOCKS_PER_SEC << " seconds" << endl;
+            break;
+
+        case 6: // Perform index sort
+            ticks = clock(); // Start timer
+            applyPermutation(bids, sortedIndex(bids)); // Sort positions, then move each bid once
+            ticks = clock() - ticks; // Calculate elapsed time
+            cout << bids.size() << " bids sorted" << endl;
+            cout << "time: " << ticks << " clock ticks" << endl;
+            cout << "time: " << ticks * 1.0 / CLOCKS_PER_SEC << " seconds" << endl;
+            break;
+
+        case 7: // Perform radix sort by title
+            ticks = clock(); // Start timer
+            radixSort(bids, &Bid::title); // Distribute bids byte by byte
+            ticks = clock() - ticks; // Calculate elapsed time
+            cout << bids.size() << " bids sorted" << endl;
+            cout << "time: " << ticks << " clock ticks" << endl;
+            cout << "time: " << ticks * 1.0 / CLOCKS_PER_SEC << " seconds" << endl;
+            break;
+
+        case 8: // Perform radix sort by auction ID
+            ticks = clock(); // Start timer
+            radixSort(bids, &Bid::bidId); // Distribute bids byte by byte
+            ticks = clock() - ticks; // Calculate elapsed time
+            cout << bids.size() << " bids sorted" << endl;
+            cout << "time: " << ticks << " clock ticks" << endl;
+            cout << "time: " << ticks * 1.0 / CLOCKS_PER_SEC << " seconds" << endl;
+            break;
+
+        case 10: // Perform radix sort by amount
+            ticks = clock(); // Start timer
+            radixSortByAmount(bids); // Sort on the encoded amounts
+            ticks = clock() - ticks; // Calculate elapsed time
+            cout << bids.size() << " bids sorted" << endl;
+            cout << "time: " << ticks << " clock ticks" << endl;
+            cout << "time: " << ticks * 1.0 / CLOCKS_PER_SEC << " seconds" << endl;
+            break;
+
+        case 11: // Perform radix sort by numeric auction ID
+            ticks = clock(); // Start timer
+            radixSortByAuctionId(bids); // Sort on the numeric IDs
+            ticks = clock() - ticks; // Calculate elapsed time
+            cout << bids.size() << " bids sorted" << endl;
+            cout << "time: " << ticks << " clock ticks" << endl;
+            cout << "time: " << ticks * 1.0 / CLOCKS_PER_SEC << " seconds" << endl;
+            break;
+
+        case 12: // Perform parallel quick sort
+            ticks = clock(); // Start timer
+            parallelQuickSort(bids, *pool); // Sort bids on the pool
+            ticks = clock() - ticks; // Calculate elapsed time
+            cout << bids.size() << " bids sorted on " << pool->size() << " threads" << endl;
+            cout << "time: " << ticks << " clock ticks" << endl;
+            cout << "time: " << ticks * 1.0 / CLOCKS_PER_SEC << " seconds" << endl;
+            break;
+
+        case 13: // Perform parallel merge sort
+            ticks = clock(); // Start timer
+            parallelMergeSort(bids, *pool); // Sort bids on the pool, keeping ties in order
+            ticks = clock() - ticks; // Calculate elapsed time
+            cout << bids.size() << " bids sorted on " << pool->size() << " threads" << endl;
+            cout << "time: " << ticks << " clock ticks" << endl;
+            cout << "time: " << ticks * 1.0 / CLOCKS_PER_SEC << " seconds" << endl;
+            break;
+
+        case 14: // Choose the thread count for the parallel sorts
+            cout << "Enter thread count (0 = all cores): ";
+            cin >> threadCount;
+            pool.reset(); // Restarted with the new count on next use
+            break;
+
+        case 15: // Perform a stable multi-key sort
+            ticks = clock(); // Start timer
+            mergeSort(bids, OrderBy<ByFund, Descending<ByAmount>, ByTitle>()); // Fund, then amount, then title
+            ticks = clock() - ticks; // Calculate elapsed time
+            cout << bids.size() << " bids sorted" << endl;
+            cout << "time: " << ticks << " clock ticks" << endl;
+            cout << "time: " << ticks * 1.0 / CLOCKS_PER_SEC << " seconds" << endl;
+            break;
+
+        case 16: { // Display the top N bids by amount or title
+            size_t count = 0; // How many bids to show
+            int key = 0; // What to rank by
+            cout << "Enter N: ";
+            cin >> count;
+            cout << "Rank by (1 = highest amount, 2 = title): ";
+            cin >> key;
+
+            ticks = clock(); // Start timer
+            vector<Bid> top = (key == 2) ? topBids(bids, count, TitleOrder())
+                                         : topBids(bids, count, OrderBy<Descending<ByAmount>, ByTitle>());
+            ticks = clock() - ticks; // Calculate elapsed time
+            displayBids(top); // Display each of the top bids
+            cout << top.size() << " of " << bids.size() << " bids selected" << endl;
+            cout << "time: " << ticks << " clock ticks" << endl;
+            cout << "time: " << ticks * 1.0 / CLOCKS_PER_SEC << " seconds" << endl;
+            break;
+        }
+
+        case 17: { // Append another file, keeping title order if the bids have it
+            string appendPath; // File to append
+            cout << "Enter CSV path: ";
+            cin >> appendPath;
+
+            ticks = clock(); // Start timer
+            size_t added = store.sortedByTitle ? appendSortedBids(appendPath, store)
+                                               : appendBids(appendPath, store);
+            ticks = clock() - ticks; // Calculate elapsed time
+            cout << added << " bids appended, " << bids.size() << " in total"
+                 << (store.sortedByTitle ? " (sorted by title)" : "") << endl;
+            cout << "time: " << ticks << " clock ticks" << endl;
+            cout << "time: " << ticks * 1.0 / CLOCKS_PER_SEC << " seconds" << endl;
+            break;
+        }
+
+        case 18: { // Sort a file through bounded-memory runs on disk
+            string inPath; // File to sort
+            string outPath; // Sorted CSV to write
+            size_t megabytes = 0; // Memory budget
+            ExternalSortOptions options; // Budget and temporary directory
+            cout << "Enter CSV path: ";
+            cin >> inPath;
+            cout << "Enter output path: ";
+            cin >> outPath;
+            cout << "Enter memory budget in MB: ";
+            cin >> megabytes;
+            cout << "Enter temporary directory: ";
+            cin >> options.tempDir;
+            options.memoryBudget = megabytes << 20;
+
+            ticks = clock(); // Start timer
+            try {
+                size_t written = externalSort(inPath, outPath, options); // Sort by title
+                cout << written << " bids sorted into " << outPath << endl;
+            } catch (const exception& e) {
+                cerr << "External sort failed: " << e.what() << endl;
+            }
+            ticks = clock() - ticks; // Calculate elapsed time
+            cout << "time: " << ticks << " clock ticks" << endl;
+            cout << "time: " << ticks * 1.0 / CLOCKS_PER_SEC << " seconds" << endl;
+            break;
+        }
+
+        case 19: // Save the bids as a binary snapshot
+        case 20: { // Replace the bids with a saved snapshot
+            string snapshotPath; // Snapshot file
+            cout << "Enter snapshot path: ";
+            cin >> snapshotPath;
+
+            ticks = clock(); // Start timer
+            try {
+                if (choice == 19) {
+                    saveSnapshot(store, snapshotPath);
+                    cout << bids.size() << " bids saved" << endl;
+                } else {
+                    store = loadSnapshot(snapshotPath);
+                    cout << bids.size() << " bids read" << endl;
+                }
+            } catch (const exception& e) {
+                cerr << "Snapshot failed: " << e.what() << endl;
+            }
+            ticks = clock() - ticks; // Calculate elapsed time
+            cout << "time: " << ticks << " clock ticks" << endl;
+            cout << "time: " << ticks * 1.0 / CLOCKS_PER_SEC << " seconds" << endl;
+            break;
+        }
+
+        case 21: { // Write every bid to a file or pipe
+            string exportPath; // File to write, or - for the console
+            cout << "Enter output path (- for console): ";
+            cin >> exportPath;
+
+            ticks = clock(); // Start timer
+            try {
+                exportBids(bids, exportPath);
+                cout << bids.size() << " bids written" << endl;
+            } catch (const exception& e) {
+                cerr << "Export failed: " << e.what() << endl;
+            }
+            ticks = clock() - ticks; // Calculate elapsed time
+            cout << "time: " << ticks << " clock ticks" << endl;
+            cout << "time: " << ticks * 1.0 / CLOCKS_PER_SEC << " seconds" << endl;
+            break;
+        }
+
+        case 22: // Find one bid
+        case 23: { // Delete one bid
+            string bidId; // Auction ID to look for
+            cout << "Enter auction ID: ";
+            cin >> bidId;
+
+            ticks = clock(); // Start timer
+            Bid* found = (choice == 22) ? findBid(store, bidId) : nullptr; // The bid, if any
+            bool deleted = (choice == 23) && deleteBid(store, bidId); // Whether a bid went
+            ticks = clock() - ticks; // Calculate elapsed time
+            if (found != nullptr) {
+                displayBid(*found);
+            } else if (deleted) {
+                cout << "Bid " << bidId << " deleted" << endl;
+            } else {
+                cout << "Bid " << bidId << " not found" << endl;
+            }
+            cout << "time: " << ticks << " clock ticks" << endl;
+            cout << "time: " << ticks * 1.0 / CLOCKS_PER_SEC << " seconds" << endl;
+            break;
+        }
+
+        case 24: { // Insert or replace one bid
+            Bid bid = getBid(store); // The bid as entered
+            bool inserted = upsertBid(store, bid);
+            cout << "Bid " << bid.bidId << (inserted ? " added" : " updated") << endl;
+            break;
+        }
+
+        case 25: { // Range query over the secondary indexes
+            double minAmount = 0.0; // Smallest amount wanted
+            double maxAmount = 0.0; // Largest amount wanted
+            string fromText; // First close date wanted
+            string toText; // Last close date wanted
+            uint32_t fromDate = 0; // fromText as yyyymmdd
+            uint32_t toDate = 0; // toText as yyyymmdd
+            cout << "Enter lowest amount: ";
+            cin >> minAmount;
+            cout << "Enter highest amount: ";
+            cin >> maxAmount;
+            cout << "Enter first close date (m/d/yyyy): ";
+            cin >> fromText;
+            cout << "Enter last close date (m/d/yyyy): ";
+            cin >> toText;
+            if (!parseDate(fromText, fromDate) || !parseDate(toText, toDate)) {
+                cout << "Dates must look like 6/9/2014" << endl;
+                break;
+            }
+
+            ticks = clock(); // Start timer
+            vector<uint32_t> found = findBidsInRange(store, minAmount, maxAmount, fromDate, toDate);
+            ticks = clock() - ticks; // Calculate elapsed time
+            BidView view(bids, found); // The matches, without moving any bid
+            {
+                BidWriter writer(cout); // Flushed before the summary
+                for (size_t i = 0; i < view.size(); i++) {
+                    writer.write(view[i]);
+                }
+            }
+            cout << found.size() << " bids found" << endl;
+            cout << "time: " << ticks << " clock ticks" << endl;
+            cout << "time: " << ticks * 1.0 / CLOCKS_PER_SEC << " seconds" << endl;
+            break;
+        }
+
+        case 26: { // Copy the bids into columns and total each fund
+            BidTable table; // Column store of the loaded bids
+            ticks = clock(); // Start timer
+            buildBidTable(store.bids, table);
+            ticks = clock() - ticks; // Calculate elapsed time
+            cout << table.size() << " bids copied into columns in " << ticks * 1.0 / CLOCKS_PER_SEC << " seconds" << endl;
+
+            ticks = clock(); // Start timer
+            vector<AmountTotals> totals = totalsByFund(table);
+            ticks = clock() - ticks; // Calculate elapsed time
+            for (uint32_t id = 0; id < totals.size(); id++) {
+                cout << table.funds.name(id) << " | " << totals[id].count << " bids | total "
+                     << formatMoney(totals[id].sum) << " | min " << formatMoney(totals[id].min)
+                     << " | max " << formatMoney(totals[id].max) << endl;
+            }
+            cout << "time: " << ticks << " clock ticks" << endl;
+            cout << "time: " << ticks * 1.0 / CLOCKS_PER_SEC << " seconds" << endl;
+            break;
+        }
+
+        case 27: { // Group the loaded bids by fund or department
+            int key = 0; // What to group by
+            cout << "Group by (1 = fund, 2 = department): ";
+            cin >> key;
+
+            BidTable table; // Column store of the loaded bids
+            buildBidTable(store.bids, table);
+            size_t matched = joinBidDetails(csvPath, table); // Departments and fees come from the file
+            if (matched != table.size()) {
+                cout << table.size() - matched << " bids not in " << csvPath << " have no department or fees" << endl;
+            }
+            const StringPool& names = (key == 2) ? table.departments : table.funds; // Group names
+
+            ticks = clock(); // Start timer
+            vector<GroupTotals> totals = groupTotals(table, (key == 2) ? table.departmentIds : table.fundIds,
+                                                     names.size(), *pool);
+            ticks = clock() - ticks; // Calculate elapsed time
+            for (uint32_t id = 0; id < totals.size(); id++) {
+                if (totals[id].rows == 0) {
+                    continue; // E.g. the empty department when every bid was found
+                }
+                cout << names.name(id) << " | " << totals[id].rows << " bids" << endl;
+                for (size_t m = 0; m < MEASURE_COUNT; m++) {
+                    const AmountTotals& measure = totals[id].measures[m];
+                    if (measure.count != 0) {
+                        cout << "    " << MEASURE_NAMES[m] << ": total " << formatMoney(measure.sum)
+                             << ", avg " << formatMoney(measure.sum / measure.count)
+                             << ", min " << formatMoney(measure.min) << ", max " << formatMoney(measure.max) << endl;
+                    }
+                }
+            }
+            cout << table.size() << " bids grouped on " << pool->size() << " threads" << endl;
+            cout << "time: " << ticks << " clock ticks" << endl;
+            cout << "time: " << ticks * 1.0 / CLOCKS_PER_SEC << " seconds" << endl;
+            break;
+        }
+        }
+
+        if (titleSort) {
+            store.sortedByTitle = true;
+        } else if (choice == 8 || choice == 10 || choice == 11 || choice == 15) {
+            store.sortedByTitle = false; // Reordered on another key
+        }
+        if (choice == 1 || choice == 17 || choice == 20 || store.bids.empty()
+            || (choice >= 3 && choice <= 15 && choice != 9 && choice != 14)) {
+            store.dropIndexes(); // Bids were loaded or moved; rebuilt on the next query
         }
     }
 
     cout << "Good bye." << endl; // Exit message
     return 0;
 }
+#endif